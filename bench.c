@@ -0,0 +1,397 @@
+// Telex/VNI/VIQR engine microbenchmarks
+//
+// Usage: ./bench_telex [min_keys]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/input.h>
+#include "telex.h"
+#include "device.h"
+#include "conv.h"
+
+#define DEFAULT_MIN_KEYS 2000000
+
+// Realistic Telex keystrokes: prose, hard syllables and double-press undo
+static const char *corpus =
+    "Tieengs Vieejt laf ngoon ngwx chinhs thwcs cuar nuwowcs Coongj hoaf xax "
+    "hooji chur nghiax Vieejt Nam. Ddaay laf tieengs mej ddeer cuar hown chins "
+    "muwowi trieeuj nguwowif. Nguwowif Vieejt ddax suwr dungj chuwx Quoocs ngwx "
+    "trong giaos ducj, baos chis vaf vaawn hocj. Hoom nay troowif ddepj quas, "
+    "chungs tooi ddi chowi coong vieen vaf awn kem. Banj cos khoer khoong? "
+    "Tooi raats vui vif dduwowcj gaawpj banj. Thuwowngf xuyeen luyeenj taapj "
+    "gox nhanh giups nguwowif dungf tieets kieemj thowif gian. "
+    "nghieeng khuyur giuwax ddeem khuya quyeenf nguyeenx thuowr huwowngs "
+    "tuwowngr ddieeuf chuyeenj ngoaif khoer thuys hoaj giaf quar "
+    "gass chaoo luaas masss tuooi cassr booo";
+
+// The same text in VNI and VIQR: marks after their vowel, tones at the end
+// of the word. No sentence punctuation, VIQR types tones with . and ?
+static const char *corpus_vni =
+    "Tie6ng1 Vie6t5 la2 ngo6n ngu74 chinh1 thu7c1 cua3 nu7o7c1 Co6ng5 hoa2 xa4 "
+    "ho6i5 chu3 nghia4 Vie6t5 Nam D9a6y la2 tie6ng1 me5 d9e3 cua3 ho7n chin1 "
+    "mu7o7i trie6u5 ngu7o7i2 Ngu7o7i2 Vie6t5 d9a4 su73 dung5 chu74 Quo6c1 ngu74 "
+    "trong giao1 duc5 bao1 chi1 va2 va8n hoc5 Ho6m nay tro7i2 d9ep5 qua1 chung1 "
+    "to6i d9i cho7i co6ng vie6n va2 a8n kem Ban5 co1 khoe3 kho6ng To6i ra6t1 "
+    "vui vi2 d9u7o7c5 ga8p5 ban5 Thu7o7ng2 xuye6n luye6n5 ta6p5 go4 nhanh giup1 "
+    "ngu7o7i2 dung2 tie6t1 kie6m5 tho7i2 gian nghie6ng khuyu3 giu7a4 d9e6m "
+    "khuya quye6n2 nguye6n4 thuo73 hu7o7ng1 tu7o7ng3 d9ie6u2 chuye6n5 ngoai2 "
+    "khoe3 thuy1 hoa5 gia2 qua3 ga11 cha66o lu7a77 ma111 bo666";
+
+static const char *corpus_viqr =
+    "Tie^ng' Vie^t. la` ngo^n ngu+~ chinh' thu+c' cua? nu+o+c' Co^ng. hoa` xa~ "
+    "ho^i. chu? nghia~ Vie^t. Nam Dda^y la` tie^ng' me. dde? cua? ho+n chin' "
+    "mu+o+i trie^u. ngu+o+i` Ngu+o+i` Vie^t. dda~ su+? dung. chu+~ Quo^c' ngu+~ "
+    "trong giao' duc. bao' chi' va` va(n hoc. Ho^m nay tro+i` ddep. qua' chung' "
+    "to^i ddi cho+i co^ng vie^n va` a(n kem Ban. co' khoe? kho^ng To^i ra^t' "
+    "vui vi` ddu+o+c. ga(p. ban. Thu+o+ng` xuye^n luye^n. ta^p. go~ nhanh giup' "
+    "ngu+o+i` dung` tie^t' kie^m. tho+i` gian nghie^ng khuyu? giu+a~ dde^m "
+    "khuya quye^n` nguye^n~ thuo+? hu+o+ng' tu+o+ng? ddie^u` chuye^n. ngoai` "
+    "khoe? thuy' hoa. gia` qua? ga'' cha^^o lu+a++ ma''' bo^^^";
+
+// Plain English for the conversion pass-through path
+static const char *english =
+    "The quick brown fox jumps over the lazy dog while the build runs. "
+    "Logs, notes and source code are mostly ASCII that must come out untouched; "
+    "only words typed in Telex are rewritten. ";
+
+typedef struct {
+    char keys[MAX_WORD_LEN];
+    int len;
+} Keys;
+
+typedef struct {
+    const char *name;
+    const char *text;
+    Keys *words;
+    int n_words;
+    long keys;
+} Corpus;
+
+static Corpus corpora[METHOD_COUNT] = {
+    [METHOD_TELEX] = { "process/telex", NULL, NULL, 0, 0 },
+    [METHOD_VNI] = { "process/vni", NULL, NULL, 0, 0 },
+    [METHOD_VIQR] = { "process/viqr", NULL, NULL, 0, 0 },
+};
+
+static inline long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Letters and method keys (VNI digits, VIQR punctuation) make up words
+static inline bool is_word_char(InputMethod method, char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || telex_is_method_key(method, c);
+}
+
+static void load_corpus(InputMethod method) {
+    Corpus *c = &corpora[method];
+    int cap = 64;
+    c->words = malloc(sizeof(Keys) * cap);
+
+    const char *p = c->text;
+    while (*p) {
+        while (*p && !is_word_char(method, *p)) p++;
+        if (!*p) break;
+        if (c->n_words == cap) {
+            cap *= 2;
+            c->words = realloc(c->words, sizeof(Keys) * cap);
+        }
+        Keys *w = &c->words[c->n_words];
+        w->len = 0;
+        while (*p && is_word_char(method, *p)) {
+            if (w->len < MAX_WORD_LEN - 1) w->keys[w->len++] = *p;
+            p++;
+        }
+        c->keys += w->len;
+        c->n_words++;
+    }
+}
+
+// Same steps keyboard.c takes for one word key
+static inline void type_key(Word *word, InputMethod method, char c) {
+    if (word->len > 0 && telex_is_method_key(method, c)) {
+        TelexCheckpoint cp = telex_checkpoint(word);
+        int result = telex_process_method(word, method, c);
+        if (result == 1) return;
+        if (result == 0) telex_rollback(word, cp);
+        // result 2 (undo) and 0 both add the key char
+    }
+    telex_append(word, c);
+}
+
+static void type_word(Word *word, InputMethod method, const Keys *k) {
+    telex_reset(word);
+    for (int i = 0; i < k->len; i++) type_key(word, method, k->keys[i]);
+}
+
+// Cost of one clock_gettime() pair, subtracted from per-call samples
+static long long timer_overhead(void) {
+    long long s[1001];
+    for (int i = 0; i < 1001; i++) {
+        long long t0 = now_ns();
+        s[i] = now_ns() - t0;
+    }
+    qsort(s, 1001, sizeof(long long), cmp_ll);
+    return s[500];
+}
+
+// Percentile of sorted samples, minus timer overhead
+static long long pct(const long long *sorted, int n, double p, long long overhead) {
+    long long v = sorted[(int)((n - 1) * p)] - overhead;
+    return v < 0 ? 0 : v;
+}
+
+static void report(const char *name, long ops, long long total_ns,
+                   long long *samples, int n_samples, long long overhead) {
+    qsort(samples, n_samples, sizeof(long long), cmp_ll);
+    double ns = (double)total_ns / ops;
+    printf("%-24s ops=%-9ld ns/op=%7.1f  ops/sec=%7.2fM  p50=%5lldns  p99=%5lldns  p999=%5lldns\n",
+           name, ops, ns, 1e3 / ns,
+           pct(samples, n_samples, 0.50, overhead),
+           pct(samples, n_samples, 0.99, overhead),
+           pct(samples, n_samples, 0.999, overhead));
+}
+
+// telex_process_method(): full typing path, per key
+static void bench_process(InputMethod method, long min_keys, long long overhead) {
+    const Corpus *c = &corpora[method];
+    int rounds = (int)((min_keys + c->keys - 1) / c->keys);
+    Word word;
+    long long t0 = now_ns();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < c->n_words; i++) type_word(&word, method, &c->words[i]);
+    long long total = now_ns() - t0;
+
+    int n = (int)c->keys * (rounds < 20 ? rounds : 20);
+    long long *samples = malloc(sizeof(long long) * n);
+    int k = 0;
+    for (int r = 0; r < 20 && r < rounds; r++) {
+        for (int i = 0; i < c->n_words; i++) {
+            telex_reset(&word);
+            for (int j = 0; j < c->words[i].len; j++) {
+                long long s = now_ns();
+                type_key(&word, method, c->words[i].keys[j]);
+                samples[k++] = now_ns() - s;
+            }
+        }
+    }
+    report(c->name, c->keys * rounds, total, samples, k, overhead);
+    free(samples);
+}
+
+typedef void (*WordFn)(Word *word, char *buf);
+
+static void fn_valid(Word *word, char *buf) {
+    buf[0] = (char)telex_is_valid_syllable(word);
+}
+
+static void fn_normalize(Word *word, char *buf) {
+    (void)buf;
+    telex_normalize_tone(word);
+}
+
+static void fn_utf8(Word *word, char *buf) {
+    word_to_utf8(word, buf, MAX_WORD_LEN * 4 + 1);
+}
+
+static TextEncoding bench_encoding;
+
+static void fn_encode(Word *word, char *buf) {
+    word_tail_encode(word, 0, bench_encoding, buf, MAX_WORD_LEN * ENC_MAX_BYTES + 1);
+}
+
+// Per-word function over the typed Telex corpus words
+static void bench_word_fn(const char *name, WordFn fn, int rounds, long long overhead) {
+    const Keys *words = corpora[METHOD_TELEX].words;
+    int n_words = corpora[METHOD_TELEX].n_words;
+    // Word is cache-line aligned (sizeof is a multiple of the alignment)
+    Word *typed = aligned_alloc(_Alignof(Word), sizeof(Word) * n_words);
+    for (int i = 0; i < n_words; i++) type_word(&typed[i], METHOD_TELEX, &words[i]);
+
+    char buf[MAX_WORD_LEN * ENC_MAX_BYTES + 1];
+    volatile char sink = 0;
+    long long t0 = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < n_words; i++) {
+            fn(&typed[i], buf);
+            sink ^= buf[0];
+        }
+    }
+    long long total = now_ns() - t0;
+
+    int n = n_words * 200;
+    long long *samples = malloc(sizeof(long long) * n);
+    for (int k = 0; k < n; k++) {
+        long long s = now_ns();
+        fn(&typed[k % n_words], buf);
+        samples[k] = now_ns() - s;
+    }
+    report(name, (long)n_words * rounds, total, samples, n, overhead);
+    free(samples);
+    free(typed);
+}
+
+// Old discovery: open event0..19 and query each node's key bits
+static int probe_by_open(void) {
+    int found = 0;
+    for (int i = 0; i < 20; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/dev/input/event%d", i);
+        int fd = open(path, O_RDONLY | O_NONBLOCK);
+        if (fd < 0) continue;
+
+        unsigned long bits[KEY_CNT / (8 * sizeof(unsigned long)) + 1] = {0};
+        char name[256];
+        if (ioctl(fd, EVIOCGNAME(sizeof(name)), name) >= 0 &&
+            ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(bits)), bits) >= 0 &&
+            (bits[KEY_SPACE / (8 * sizeof(unsigned long))] >> (KEY_SPACE % (8 * sizeof(unsigned long))) & 1))
+            found++;
+        close(fd);
+    }
+    return found;
+}
+
+static int probe_sysfs(void) {
+    char paths[32][DEVICE_PATH_MAX];
+    return device_scan(paths, 32);
+}
+
+// What a restart does first: the remembered keyboard, no scan
+static int probe_cache(void) {
+    char path[DEVICE_PATH_MAX];
+    return device_cache_load(path, sizeof(path));
+}
+
+// Startup keyboard discovery, per full scan
+static void bench_discovery(const char *name, int (*scan)(void), long long overhead) {
+    enum { SCANS = 200 };
+    long long samples[SCANS];
+    int found = 0;
+
+    long long t0 = now_ns();
+    for (int i = 0; i < SCANS; i++) {
+        long long s = now_ns();
+        found = scan();
+        samples[i] = now_ns() - s;
+    }
+    long long total = now_ns() - t0;
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s (%d found)", name, found);
+    report(label, SCANS, total, samples, SCANS, overhead);
+}
+
+// conv_buffer() throughput over a 64 MiB buffer of repeated text
+static void bench_convert(const char *name, const char *text) {
+    enum { SIZE = 64 << 20, PASSES = 5 };
+    size_t tlen = strlen(text);
+    char *in = malloc(SIZE);
+    char *out = malloc(CONV_MAX_OUTPUT((size_t)SIZE));
+    for (size_t off = 0; off < SIZE; off += tlen) {
+        memcpy(in + off, text, off + tlen <= SIZE ? tlen : SIZE - off);
+    }
+
+    size_t n = 0;
+    long long best = 0;
+    for (int p = 0; p < PASSES; p++) {
+        long long t0 = now_ns();
+        n = conv_buffer(in, SIZE, out);
+        long long dt = now_ns() - t0;
+        if (p == 0 || dt < best) best = dt;
+    }
+    printf("%-24s in=%dMiB out=%zuMiB  %7.1f MB/s\n",
+           name, SIZE >> 20, n >> 20, SIZE * 1e3 / best);
+    free(out);
+    free(in);
+}
+
+// conv_stream_parallel() scaling: 256 MiB memfd -> /dev/null, 1..N threads
+static void bench_convert_scaling(const char *text) {
+    enum { SIZE = 256 << 20 };
+    int in_fd = memfd_create("bench_convert", 0);
+    int out_fd = open("/dev/null", O_WRONLY);
+    if (in_fd < 0 || out_fd < 0 || ftruncate(in_fd, SIZE) < 0) {
+        fprintf(stderr, "convert scaling: skipped (%s)\n", strerror(errno));
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+        return;
+    }
+
+    char *map = mmap(NULL, SIZE, PROT_WRITE, MAP_SHARED, in_fd, 0);
+    size_t tlen = strlen(text);
+    for (size_t off = 0; off < SIZE; off += tlen) {
+        memcpy(map + off, text, off + tlen <= SIZE ? tlen : SIZE - off);
+    }
+    munmap(map, SIZE);
+
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+    for (int jobs = 1; jobs <= cores; jobs = jobs < cores && jobs * 2 > cores ? cores : jobs * 2) {
+        lseek(in_fd, 0, SEEK_SET);
+        long long t0 = now_ns();
+        conv_stream_parallel(in_fd, out_fd, jobs);
+        double mbs = SIZE * 1e3 / (now_ns() - t0);
+        if (jobs == 1) base = mbs;
+
+        char label[32];
+        snprintf(label, sizeof(label), "convert/jobs=%d", jobs);
+        printf("%-24s %7.1f MB/s  x%.2f\n", label, mbs, mbs / base);
+    }
+    close(out_fd);
+    close(in_fd);
+}
+
+int main(int argc, char *argv[]) {
+    long min_keys = argc > 1 ? atol(argv[1]) : DEFAULT_MIN_KEYS;
+    if (min_keys <= 0) {
+        fprintf(stderr, "Usage: %s [min_keys]\n", argv[0]);
+        return 1;
+    }
+
+    telex_init();
+    corpora[METHOD_TELEX].text = corpus;
+    corpora[METHOD_VNI].text = corpus_vni;
+    corpora[METHOD_VIQR].text = corpus_viqr;
+    for (int m = 0; m < METHOD_COUNT; m++) load_corpus((InputMethod)m);
+    const Corpus *telex = &corpora[METHOD_TELEX];
+    int rounds = (int)((min_keys + telex->keys - 1) / telex->keys);
+    long long overhead = timer_overhead();
+
+    printf("corpus: %d words, %ld keys, %d rounds (timer overhead %lldns)\n",
+           telex->n_words, telex->keys, rounds, overhead);
+
+    for (int m = 0; m < METHOD_COUNT; m++) bench_process((InputMethod)m, min_keys, overhead);
+    bench_word_fn("telex_is_valid_syllable", fn_valid, rounds, overhead);
+    bench_word_fn("telex_normalize_tone", fn_normalize, rounds, overhead);
+    bench_word_fn("word_to_utf8", fn_utf8, rounds, overhead);
+    static const char *const encodings[ENC_COUNT] = {
+        "encode/unicode", "encode/nfd", "encode/tcvn3", "encode/vni-win", "encode/viscii",
+    };
+    for (int e = 0; e < ENC_COUNT; e++) {
+        bench_encoding = (TextEncoding)e;
+        bench_word_fn(encodings[e], fn_encode, rounds, overhead);
+    }
+    bench_convert("convert/telex", corpus);
+    bench_convert("convert/english", english);
+    bench_convert_scaling(corpus);
+    bench_discovery("discovery/sysfs", probe_sysfs, overhead);
+    bench_discovery("discovery/open+ioctl", probe_by_open, overhead);
+    bench_discovery("discovery/cached", probe_cache, overhead);
+
+    for (int m = 0; m < METHOD_COUNT; m++) free(corpora[m].words);
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Output latency comparison: uinput vs wtype
+//
+// Each iteration types "a", turns it into "á" and erases it again, so the
+// focused text field ends up unchanged. Focus an empty text field first.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "output.h"
+#include "keymap.h"
+
+#define DEFAULT_ITERATIONS 100
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int run(OutputMode mode, int iterations) {
+    if (output_init(mode) < 0) return -1;
+
+    int n = iterations * 3;
+    double *samples = malloc(sizeof(double) * n);
+    if (!samples) {
+        output_cleanup();
+        return -1;
+    }
+
+    int k = 0;
+    for (int i = 0; i < iterations; i++) {
+        double t0 = now_us();
+        output_replace(0, "a");
+        output_sync();
+        double t1 = now_us();
+        output_replace(1, "\xc3\xa1");  // á
+        output_sync();
+        double t2 = now_us();
+        output_replace(1, "");
+        output_sync();
+        double t3 = now_us();
+        samples[k++] = t1 - t0;
+        samples[k++] = t2 - t1;
+        samples[k++] = t3 - t2;
+    }
+
+    qsort(samples, n, sizeof(double), cmp_double);
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += samples[i];
+
+    printf("%-8s edits=%-6d avg=%9.1fus  p50=%9.1fus  p99=%9.1fus  max=%9.1fus\n",
+           output_backend_name(), n, sum / n, samples[n / 2],
+           samples[(int)(n * 0.99)], samples[n - 1]);
+
+    free(samples);
+    output_cleanup();
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = DEFAULT_ITERATIONS;
+    bool want_uinput = true, want_wtype = true;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "uinput") == 0) want_wtype = false;
+        else if (strcmp(argv[i], "wtype") == 0) want_uinput = false;
+        else iterations = atoi(argv[i]);
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [uinput|wtype] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    keymap_load(NULL);
+    printf("Focus an empty text field. Starting in 3 seconds...\n");
+    sleep(3);
+
+    // Time until the edit has been handed off (uinput write / wtype exit)
+    if (want_uinput && run(OUTPUT_UINPUT, iterations) < 0)
+        fprintf(stderr, "uinput: skipped\n");
+    if (want_wtype) run(OUTPUT_WTYPE, iterations);
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "unikey.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Telex behaviour check: every line of the golden corpus is a key sequence
+// typed into one word, with the word and the text-field contents the
+// engine produced before it became table-driven. Each sequence goes
+// through unikey_key() as the daemon does (the raw key reaches the app,
+// then the edit replaces it) and both results must match exactly
+
+#define LINE_MAX_BYTES 512
+#define FIELD_CHARS 256
+
+typedef struct {
+    uint32_t chars[FIELD_CHARS];
+    int len;
+} TextField;
+
+static void field_put(TextField *f, uint32_t cp) {
+    if (f->len < FIELD_CHARS) f->chars[f->len++] = cp;
+}
+
+static void field_backspace(TextField *f, int count) {
+    f->len = count < f->len ? f->len - count : 0;
+}
+
+// Append UTF-8 text, one codepoint per character
+static void field_type(TextField *f, const char *s, int len) {
+    const unsigned char *p = (const unsigned char *)s, *end = p + len;
+    while (p < end) {
+        uint32_t cp = *p;
+        int n = cp < 0x80 ? 1 : cp < 0xE0 ? 2 : cp < 0xF0 ? 3 : 4;
+        if (n > 1) cp &= 0x3F >> (n - 1);
+        for (int i = 1; i < n && p + i < end; i++) cp = (cp << 6) | (p[i] & 0x3F);
+        field_put(f, cp);
+        p += n;
+    }
+}
+
+static void field_utf8(const TextField *f, char *out, size_t size) {
+    size_t o = 0;
+    for (int i = 0; i < f->len && o + 4 < size; i++) {
+        uint32_t cp = f->chars[i];
+        if (cp < 0x80) {
+            out[o++] = (char)cp;
+        } else if (cp < 0x800) {
+            out[o++] = (char)(0xC0 | (cp >> 6));
+            out[o++] = (char)(0x80 | (cp & 0x3F));
+        } else {
+            out[o++] = (char)(0xE0 | (cp >> 12));
+            out[o++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            out[o++] = (char)(0x80 | (cp & 0x3F));
+        }
+    }
+    out[o] = '\0';
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "telex_golden.txt";
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    UnikeyEngine *engine = unikey_new();
+    if (!engine) {
+        fclose(in);
+        return 1;
+    }
+
+    char line[LINE_MAX_BYTES];
+    int lineno = 0, checked = 0, failed = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') continue;
+
+        // keys <TAB> word <TAB> text field
+        char *keys = line;
+        char *word = strchr(keys, '\t');
+        char *field = word ? strchr(word + 1, '\t') : NULL;
+        if (!field) {
+            fprintf(stderr, "%s:%d: malformed line\n", path, lineno);
+            failed++;
+            continue;
+        }
+        *word++ = '\0';
+        *field++ = '\0';
+
+        TextField text = { .len = 0 };
+        unikey_reset(engine);
+        for (const char *k = keys; *k; k++) {
+            field_put(&text, (unsigned char)*k);
+            UnikeyEdit edit;
+            if (unikey_key(engine, *k, &edit)) {
+                field_backspace(&text, edit.backspaces + 1);
+                field_type(&text, edit.text, edit.text_len);
+            }
+        }
+
+        char got_word[FIELD_CHARS * 3 + 1], got_field[FIELD_CHARS * 3 + 1];
+        unikey_word(engine, got_word, sizeof(got_word));
+        field_utf8(&text, got_field, sizeof(got_field));
+        checked++;
+        if (strcmp(got_word, word) != 0 || strcmp(got_field, field) != 0) {
+            fprintf(stderr, "%s:%d: %s -> word \"%s\" text \"%s\", expected \"%s\" \"%s\"\n",
+                    path, lineno, keys, got_word, got_field, word, field);
+            failed++;
+        }
+    }
+    fclose(in);
+    unikey_free(engine);
+
+    printf("telex: %d sequences, %d failed\n", checked, failed);
+    return failed > 0;
+}
@@ -0,0 +1,489 @@
+#define _GNU_SOURCE
+#include "conv.h"
+#include "telex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define READ_SIZE   (1 << 20)
+#define ARENA_SIZE  (256 << 10)
+#define IOV_BATCH   1024
+#define SMALL_SLICE 512         // Cheaper to copy than to give its own iovec
+#define CHUNK_SIZE  (1 << 20)     // Parallel mode: input per work item
+#define CACHE_BITS  12
+#define CACHE_KEY_MAX 15
+
+// ============================================================================
+// WORD CONVERSION
+// ============================================================================
+
+// Byte classes for the scan and for ruling out words the engine cannot change
+enum {
+    C_LETTER = 1,       // A-Z a-z
+    C_TRIGGER = 2,      // s f r x j w: tone or horn, may transform on its own
+    C_DOUBLE = 4,       // a e o: transforms only right after itself
+    C_D = 8,            // d: transforms only with an earlier d
+};
+
+static const uint8_t byte_class[256] = {
+#define L(c) [c] = C_LETTER, [c - 32] = C_LETTER
+#define T(c) [c] = C_LETTER | C_TRIGGER, [c - 32] = C_LETTER | C_TRIGGER
+#define D(c) [c] = C_LETTER | C_DOUBLE, [c - 32] = C_LETTER | C_DOUBLE
+    D('a'), L('b'), L('c'), ['d'] = C_LETTER | C_D, ['D'] = C_LETTER | C_D,
+    D('e'), T('f'), L('g'), L('h'), L('i'), T('j'), L('k'), L('l'), L('m'),
+    L('n'), D('o'), L('p'), L('q'), T('r'), T('s'), L('t'), L('u'), L('v'),
+    T('w'), T('x'), L('y'), L('z'),
+#undef L
+#undef T
+#undef D
+};
+
+// False when no key of the word can transform: no tone/horn key, no
+// doubled a/e/o and at most one d. Most English and plain ASCII words
+static bool may_transform(const char *w, size_t len) {
+    int d_count = 0;
+    uint8_t prev = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)w[i] | 0x20;
+        uint8_t cls = byte_class[c];
+        if (cls & C_TRIGGER) return true;
+        if ((cls & C_DOUBLE) && c == prev) return true;
+        if ((cls & C_D) && ++d_count > 1) return true;
+        prev = c;
+    }
+    return false;
+}
+
+// Type one word the way keyboard.c does. Returns UTF-8 length, or -1 when
+// the word comes out exactly as typed
+static int convert_word(const char *w, size_t len, char *utf8, int size) {
+    if (len > MAX_WORD_LEN - 1 || !may_transform(w, len)) return -1;
+
+    Word word;
+    telex_reset(&word);
+    for (size_t i = 0; i < len; i++) {
+        if (word.len > 0) {
+            TelexCheckpoint cp = telex_checkpoint(&word);
+            int result = telex_process(&word, w[i]);
+            if (result == 1) continue;
+            if (result == 0) telex_rollback(&word, cp);
+        }
+        telex_append(&word, (uint8_t)w[i]);
+    }
+
+    // Every recorded transformation changes the text
+    if (word.history_len == 0) return -1;
+    return word_to_utf8(&word, utf8, size);
+}
+
+// Natural text repeats a small vocabulary: converted words are memoized in
+// a direct-mapped cache, one 64-byte entry per word, one cache per thread
+typedef struct {
+    _Alignas(64) uint8_t key_len;   // 0 = empty
+    int8_t out_len;                 // -1 = comes out as typed
+    char key[CACHE_KEY_MAX];
+    char out[CACHE_KEY_MAX * 3];
+} CacheEntry;
+
+static _Thread_local CacheEntry word_cache[1 << CACHE_BITS];
+
+// Converted word (NULL when unchanged) through the cache
+static const char *lookup_word(const char *w, size_t len, uint32_t hash, int *out_len) {
+    static _Thread_local char utf8[MAX_WORD_LEN * 4 + 1];
+    if (len > CACHE_KEY_MAX) {
+        *out_len = convert_word(w, len, utf8, sizeof(utf8));
+        return *out_len < 0 ? NULL : utf8;
+    }
+
+    CacheEntry *e = &word_cache[(hash ^ (hash >> 16)) & ((1 << CACHE_BITS) - 1)];
+    if (e->key_len != len || memcmp(e->key, w, len) != 0) {
+        int n = convert_word(w, len, utf8, sizeof(utf8));
+        e->key_len = (uint8_t)len;
+        e->out_len = (int8_t)n;
+        memcpy(e->key, w, len);
+        if (n > 0) memcpy(e->out, utf8, (size_t)n);
+    }
+    *out_len = e->out_len;
+    return e->out_len < 0 ? NULL : e->out;
+}
+
+size_t conv_run(const char *in, size_t len, bool final, ConvEmit emit, void *ctx) {
+    size_t span = 0;    // Start of the pending unchanged slice
+    size_t i = 0;
+
+    while (i < len) {
+        if (!(byte_class[(uint8_t)in[i]] & C_LETTER)) {
+            i++;
+            continue;
+        }
+
+        size_t start = i;
+        uint32_t hash = 2166136261u;
+        while (i < len && (byte_class[(uint8_t)in[i]] & C_LETTER)) {
+            hash = (hash ^ (uint8_t)in[i]) * 16777619u;
+            i++;
+        }
+
+        if (i == len && !final) {
+            // The word may go on in the next buffer. A run that is already
+            // too long for the engine passes through; keep enough of it
+            // that the next call still sees it as too long
+            size_t keep = i - start > MAX_WORD_LEN ? MAX_WORD_LEN : i - start;
+            i -= keep;
+            break;
+        }
+
+        int n;
+        const char *out = lookup_word(in + start, i - start, hash, &n);
+        if (!out) continue;
+
+        if (start > span) emit(ctx, in + span, start - span);
+        emit(ctx, out, (size_t)n);
+        span = i;
+    }
+
+    if (i > span) emit(ctx, in + span, i - span);
+    return i;
+}
+
+// Bytes conv_run() consumes from a non-final buffer: up to the trailing
+// word, or all but MAX_WORD_LEN letters of a run that is already too long
+static size_t conv_split(const char *in, size_t len) {
+    size_t r = 0;
+    while (r < len && r <= MAX_WORD_LEN && (byte_class[(uint8_t)in[len - 1 - r]] & C_LETTER)) r++;
+    return len - (r > MAX_WORD_LEN ? MAX_WORD_LEN : r);
+}
+
+// ============================================================================
+// IN-MEMORY CONVERSION
+// ============================================================================
+
+static void emit_copy(void *ctx, const char *data, size_t len) {
+    char **out = ctx;
+    memcpy(*out, data, len);
+    *out += len;
+}
+
+size_t conv_buffer(const char *in, size_t len, char *out) {
+    char *p = out;
+    conv_run(in, len, true, emit_copy, &p);
+    return (size_t)(p - out);
+}
+
+// ============================================================================
+// STREAMING CONVERSION
+// ============================================================================
+
+// Gathered output: long slices of the input buffer are referenced, converted
+// words and short slices are copied to an arena, all of it goes out with
+// writev()
+typedef struct {
+    int fd;
+    int err;
+    int n_iov;
+    const char *in, *in_end;    // Input buffer, valid until the next flush
+    size_t used;
+    struct iovec iov[IOV_BATCH];
+    char arena[ARENA_SIZE];
+} StreamOut;
+
+static void stream_flush(StreamOut *so) {
+    struct iovec *iov = so->iov;
+    int n = so->n_iov;
+
+    while (n > 0 && !so->err) {
+        ssize_t w = writev(so->fd, iov, n > IOV_MAX ? IOV_MAX : n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            so->err = errno;
+            break;
+        }
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+    so->n_iov = 0;
+    so->used = 0;
+}
+
+static void emit_gather(void *ctx, const char *data, size_t len) {
+    StreamOut *so = ctx;
+    bool copy = len < SMALL_SLICE || data < so->in || data >= so->in_end;
+
+    if (so->n_iov == IOV_BATCH || (copy && so->used + len > ARENA_SIZE)) stream_flush(so);
+    if (copy) {
+        memcpy(so->arena + so->used, data, len);
+        data = so->arena + so->used;
+        so->used += len;
+    }
+
+    // Extend the previous slice when contiguous
+    if (so->n_iov > 0) {
+        struct iovec *last = &so->iov[so->n_iov - 1];
+        if ((const char *)last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return;
+        }
+    }
+    so->iov[so->n_iov].iov_base = (void *)data;
+    so->iov[so->n_iov].iov_len = len;
+    so->n_iov++;
+}
+
+int conv_stream(int in_fd, int out_fd) {
+    char *buf = malloc(READ_SIZE + MAX_WORD_LEN);
+    StreamOut *so = malloc(sizeof(StreamOut));
+    if (!buf || !so) {
+        free(buf);
+        free(so);
+        return -1;
+    }
+    so->fd = out_fd;
+    so->err = 0;
+    so->n_iov = 0;
+    so->used = 0;
+
+    size_t have = 0;    // Unconsumed tail carried over from the last read
+    int rc = 0;
+    for (;;) {
+        ssize_t n = read(in_fd, buf + have, READ_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            rc = -1;
+            break;
+        }
+        bool final = n == 0;
+        size_t len = have + (size_t)n;
+        so->in = buf;
+        so->in_end = buf + len;
+
+        size_t used = conv_run(buf, len, final, emit_gather, so);
+        stream_flush(so);   // Input slices must go out before buf is reused
+        if (so->err) {
+            errno = so->err;
+            rc = -1;
+            break;
+        }
+        if (final) break;
+
+        have = len - used;
+        memmove(buf, buf + used, have);
+    }
+
+    free(so);
+    free(buf);
+    return rc;
+}
+
+// ============================================================================
+// PARALLEL CONVERSION
+// ============================================================================
+
+// Words carry no state across each other, so chunks cut at word
+// boundaries convert independently. The main thread reads chunks and
+// writes results in order; workers (each with its own Word and cache)
+// convert them
+typedef struct {
+    char *in;
+    char *out;
+    size_t len;         // Input bytes
+    size_t used;        // Input bytes converted (the rest is the next tail)
+    size_t out_len;
+    bool final;
+    bool done;
+} Chunk;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    Chunk *chunks;
+    int n_chunks;
+    long submitted;     // Chunks handed to the pool
+    long taken;         // Chunks picked up by a worker
+    bool quit;
+} ConvPool;
+
+static void *conv_worker(void *arg) {
+    ConvPool *pool = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->taken == pool->submitted && !pool->quit) {
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+        }
+        if (pool->taken == pool->submitted) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        Chunk *c = &pool->chunks[pool->taken++ % pool->n_chunks];
+        pthread_mutex_unlock(&pool->lock);
+
+        // The full buffer: a long letter run at the cut is judged as a whole
+        char *p = c->out;
+        conv_run(c->in, c->len, c->final, emit_copy, &p);
+
+        pthread_mutex_lock(&pool->lock);
+        c->out_len = (size_t)(p - c->out);
+        c->done = true;
+        pthread_cond_broadcast(&pool->done_cv);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static int write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Fill up to CHUNK_SIZE bytes after the carried tail; sets *eof at end of input
+static ssize_t read_chunk(int fd, char *buf, size_t have, bool *eof) {
+    size_t len = have;
+    while (len < have + CHUNK_SIZE) {
+        ssize_t n = read(fd, buf + len, have + CHUNK_SIZE - len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            *eof = true;
+            break;
+        }
+        len += (size_t)n;
+    }
+    return (ssize_t)len;
+}
+
+// Wait for a chunk, write its output
+static int drain_chunk(ConvPool *pool, Chunk *c, int out_fd) {
+    pthread_mutex_lock(&pool->lock);
+    while (!c->done) pthread_cond_wait(&pool->done_cv, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    return write_all(out_fd, c->out, c->out_len);
+}
+
+int conv_stream_parallel(int in_fd, int out_fd, int jobs) {
+    if (jobs <= 1) return conv_stream(in_fd, out_fd);
+
+    ConvPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work_cv, NULL);
+    pthread_cond_init(&pool.done_cv, NULL);
+
+    // Two chunks per worker: one converting, one read ahead
+    pool.n_chunks = jobs * 2;
+    pool.chunks = calloc((size_t)pool.n_chunks, sizeof(Chunk));
+    pthread_t *threads = calloc((size_t)jobs, sizeof(pthread_t));
+    int rc = pool.chunks && threads ? 0 : -1;
+    for (int i = 0; i < pool.n_chunks && rc == 0; i++) {
+        pool.chunks[i].in = malloc(CHUNK_SIZE + MAX_WORD_LEN);
+        pool.chunks[i].out = malloc(CONV_MAX_OUTPUT((size_t)CHUNK_SIZE + MAX_WORD_LEN));
+        if (!pool.chunks[i].in || !pool.chunks[i].out) rc = -1;
+    }
+
+    int started = 0;
+    for (; started < jobs && rc == 0; started++) {
+        if (pthread_create(&threads[started], NULL, conv_worker, &pool) != 0) rc = -1;
+    }
+
+    long seq = 0;
+    bool eof = false;
+    Chunk *prev = NULL;
+    while (rc == 0 && !eof) {
+        Chunk *c = &pool.chunks[seq % pool.n_chunks];
+        if (seq >= pool.n_chunks && drain_chunk(&pool, c, out_fd) < 0) {
+            rc = -1;
+            break;
+        }
+
+        // Word cut by the previous chunk's end starts this one
+        size_t have = prev ? prev->len - prev->used : 0;
+        if (have) memcpy(c->in, prev->in + prev->used, have);
+
+        ssize_t len = read_chunk(in_fd, c->in, have, &eof);
+        if (len < 0) {
+            rc = -1;
+            break;
+        }
+        c->len = (size_t)len;
+        c->final = eof;
+        c->used = eof ? c->len : conv_split(c->in, c->len);
+        c->done = false;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.submitted = ++seq;
+        pthread_cond_signal(&pool.work_cv);
+        pthread_mutex_unlock(&pool.lock);
+        prev = c;
+    }
+
+    // Remaining chunks, oldest first
+    long first = seq > pool.n_chunks ? seq - pool.n_chunks : 0;
+    for (long s = first; s < seq; s++) {
+        if (drain_chunk(&pool, &pool.chunks[s % pool.n_chunks], out_fd) < 0) rc = -1;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.quit = true;
+    pthread_cond_broadcast(&pool.work_cv);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    for (int i = 0; pool.chunks && i < pool.n_chunks; i++) {
+        free(pool.chunks[i].in);
+        free(pool.chunks[i].out);
+    }
+    free(pool.chunks);
+    free(threads);
+    pthread_cond_destroy(&pool.done_cv);
+    pthread_cond_destroy(&pool.work_cv);
+    pthread_mutex_destroy(&pool.lock);
+    return rc;
+}
+
+int conv_main(int argc, char *argv[], int jobs) {
+    if (argc == 0) {
+        if (conv_stream_parallel(STDIN_FILENO, STDOUT_FILENO, jobs) < 0) {
+            perror("convert");
+            return 1;
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < argc; i++) {
+        bool is_stdin = strcmp(argv[i], "-") == 0;
+        int fd = is_stdin ? STDIN_FILENO : open(argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror(argv[i]);
+            return 1;
+        }
+        int rc = conv_stream_parallel(fd, STDOUT_FILENO, jobs);
+        if (rc < 0) perror(argv[i]);
+        if (!is_stdin) close(fd);
+        if (rc < 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef CONV_H
+#define CONV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Offline Telex -> Vietnamese UTF-8 conversion. A word is a run of ASCII
+// letters; everything else (digits, punctuation, UTF-8) passes through.
+
+// Worst case output size: every letter becomes a 3-byte vowel
+#define CONV_MAX_OUTPUT(len) ((len) * 3)
+
+// Output span: either a slice of the input or a converted word
+typedef void (*ConvEmit)(void *ctx, const char *data, size_t len);
+
+// Convert in[0..len). Runs of words that come out unchanged are emitted as
+// one slice of the input, without copying. Unless final, a word cut by the
+// end of the buffer is left for the next call. Returns bytes consumed
+size_t conv_run(const char *in, size_t len, bool final, ConvEmit emit, void *ctx);
+
+// Convert a whole buffer into out (CONV_MAX_OUTPUT(len) bytes), returns
+// bytes written
+size_t conv_buffer(const char *in, size_t len, char *out);
+
+// Convert in_fd to out_fd in large buffers (input may exceed memory)
+int conv_stream(int in_fd, int out_fd);
+
+// Same, split at word boundaries into chunks converted by jobs threads;
+// output stays in input order. jobs <= 1 is conv_stream()
+int conv_stream_parallel(int in_fd, int out_fd, int jobs);
+
+// unikey --convert [FILE...]: files (or stdin) to stdout
+int conv_main(int argc, char *argv[], int jobs);
+
+#endif
@@ -0,0 +1,185 @@
+#define _GNU_SOURCE
+#include "device.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+
+#define SYSFS_INPUT "/sys/class/input"
+#define BY_ID_DIR   "/dev/input/by-id"
+#define BITS_PER_WORD (sizeof(unsigned long) * 8)
+#define KEY_WORDS   ((KEY_CNT + BITS_PER_WORD - 1) / BITS_PER_WORD)
+#define MIN_SCORE   20
+#define ROOT_CACHE_DIR "/var/cache/unikey"
+
+// ============================================================================
+// SYSFS CAPABILITIES
+// ============================================================================
+
+// Read a small sysfs attribute, newline stripped
+static bool read_attr(const char *event_name, const char *attr, char *buf, size_t size) {
+    char path[128];
+    snprintf(path, sizeof(path), SYSFS_INPUT "/%.32s/device/%s", event_name, attr);
+
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(buf, (int)size, f) != NULL;
+    fclose(f);
+    if (ok) buf[strcspn(buf, "\n")] = '\0';
+    return ok;
+}
+
+// capabilities/key: hex words, most significant first
+static bool read_key_bits(const char *event_name, unsigned long *bits) {
+    char buf[1024];
+    if (!read_attr(event_name, "capabilities/key", buf, sizeof(buf))) return false;
+
+    unsigned long words[KEY_WORDS];
+    size_t n = 0;
+    for (char *p = buf; *p && n < KEY_WORDS;) {
+        char *end;
+        unsigned long w = strtoul(p, &end, 16);
+        if (end == p) break;
+        words[n++] = w;
+        p = end;
+    }
+
+    memset(bits, 0, sizeof(unsigned long) * KEY_WORDS);
+    for (size_t i = 0; i < n; i++) bits[i] = words[n - 1 - i];
+    return n > 0;
+}
+
+static inline bool has_key(const unsigned long *bits, int code) {
+    return (bits[code / BITS_PER_WORD] >> (code % BITS_PER_WORD)) & 1;
+}
+
+// Score a device by how much of a real keyboard it looks like
+static int keyboard_score(const char *event_name) {
+    char name[256];
+    if (read_attr(event_name, "name", name, sizeof(name)) &&
+        (strstr(name, "Mouse") || strstr(name, "mouse") ||
+         strstr(name, "Virtual") || strstr(name, "UniKey"))) {
+        return 0;
+    }
+
+    unsigned long bits[KEY_WORDS];
+    if (!read_key_bits(event_name, bits)) return 0;
+
+    int score = 0;
+    for (int k = KEY_Q; k <= KEY_P; k++) score += has_key(bits, k);
+    for (int k = KEY_A; k <= KEY_L; k++) score += has_key(bits, k);
+    for (int k = KEY_Z; k <= KEY_M; k++) score += has_key(bits, k);
+    if (has_key(bits, KEY_ENTER)) score += 5;
+    if (has_key(bits, KEY_SPACE)) score += 5;
+    return score;
+}
+
+bool device_is_keyboard(const char *event_name) {
+    return strncmp(event_name, "event", 5) == 0 && keyboard_score(event_name) >= MIN_SCORE;
+}
+
+int device_scan(char paths[][DEVICE_PATH_MAX], int max) {
+    DIR *dir = opendir(SYSFS_INPUT);
+    if (!dir) return 0;
+
+    int count = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL && count < max) {
+        if (!device_is_keyboard(de->d_name)) continue;
+        snprintf(paths[count++], DEVICE_PATH_MAX, "/dev/input/%.32s", de->d_name);
+    }
+    closedir(dir);
+    return count;
+}
+
+// ============================================================================
+// STABLE IDENTITY CACHE
+// ============================================================================
+
+bool device_stable_path(const char *devnode, char *out, size_t size) {
+    DIR *dir = opendir(BY_ID_DIR);
+    if (!dir) return false;
+
+    bool found = false;
+    struct dirent *de;
+    while (!found && (de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char link[PATH_MAX], target[PATH_MAX];
+        snprintf(link, sizeof(link), BY_ID_DIR "/%s", de->d_name);
+        if (realpath(link, target) && strcmp(target, devnode) == 0) {
+            snprintf(out, size, "%s", link);
+            found = true;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+// /var/cache/unikey/keyboard for root (the system service has no HOME),
+// else $XDG_CACHE_HOME/unikey/keyboard or ~/.cache/unikey/keyboard
+static bool cache_path(char *out, size_t size, bool create_dir) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[PATH_MAX];
+
+    if (geteuid() == 0) snprintf(dir, sizeof(dir), ROOT_CACHE_DIR);
+    else if (xdg && *xdg) snprintf(dir, sizeof(dir), "%s/unikey", xdg);
+    else if (home && *home) snprintf(dir, sizeof(dir), "%s/.cache/unikey", home);
+    else return false;
+
+    if (create_dir) {
+        char parent[PATH_MAX];
+        snprintf(parent, sizeof(parent), "%s", dir);
+        char *slash = strrchr(parent, '/');
+        if (slash) {
+            *slash = '\0';
+            mkdir(parent, 0755);
+        }
+        if (mkdir(dir, 0755) < 0 && errno != EEXIST) return false;
+    }
+    return snprintf(out, size, "%s/keyboard", dir) < (int)size;
+}
+
+bool device_cache_load(char *devnode, size_t size) {
+    char path[PATH_MAX], link[PATH_MAX], target[PATH_MAX];
+    if (!cache_path(path, sizeof(path), false)) return false;
+
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(link, sizeof(link), f) != NULL;
+    fclose(f);
+    if (!ok) return false;
+    link[strcspn(link, "\n")] = '\0';
+
+    // by-id link -> current event node (the number changes across boots)
+    if (!realpath(link, target)) return false;
+    const char *name = strrchr(target, '/');
+    if (!name || !device_is_keyboard(name + 1)) return false;
+
+    snprintf(devnode, size, "%s", target);
+    return true;
+}
+
+void device_cache_save(const char *devnode) {
+    char stable[PATH_MAX], path[PATH_MAX], old[PATH_MAX] = {0};
+    if (!device_stable_path(devnode, stable, sizeof(stable))) return;
+    if (!cache_path(path, sizeof(path), true)) return;
+
+    FILE *f = fopen(path, "r");
+    if (f) {
+        if (fgets(old, sizeof(old), f)) old[strcspn(old, "\n")] = '\0';
+        fclose(f);
+    }
+    if (strcmp(old, stable) == 0) return;
+
+    f = fopen(path, "w");
+    if (!f) return;
+    fprintf(f, "%s\n", stable);
+    fclose(f);
+}
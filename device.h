@@ -0,0 +1,26 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DEVICE_PATH_MAX 64
+
+// Find keyboards from sysfs capability bitmaps, without opening any device.
+// Fills /dev/input/eventN paths, returns count
+int device_scan(char paths[][DEVICE_PATH_MAX], int max);
+
+// Check one event node by name ("event3") through sysfs
+bool device_is_keyboard(const char *event_name);
+
+// Stable /dev/input/by-id path of an event node
+bool device_stable_path(const char *devnode, char *out, size_t size);
+
+// Keyboard remembered from the last run, resolved to /dev/input/eventN
+// (one symlink and one sysfs check, no scan)
+bool device_cache_load(char *devnode, size_t size);
+
+// Remember a keyboard by its by-id path
+void device_cache_save(const char *devnode);
+
+#endif
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include "flight.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#define TEXT_MAX 32     // UTF-8 bytes kept of a word or an edit
+#define ROOT_DUMP_DIR "/run/unikey"
+
+typedef struct {
+    uint64_t start;         // Read by us (CLOCK_MONOTONIC ns)
+    uint64_t end;           // Done, edit applied
+    uint64_t event;         // Kernel timestamp, 0 if unknown
+    uint16_t code;          // evdev keycode
+    int8_t device;          // Keyboard slot, -1 replay
+    uint8_t mods;           // FLIGHT_SHIFT | ...
+    uint8_t action;         // FlightAction
+    char key;               // Letter given to the engine
+    int8_t result;          // telex_process(), -1 not run
+    uint8_t backspaces;
+    uint8_t n_changes;
+    UnikeyChange changes[4];
+    char before[TEXT_MAX];
+    char after[TEXT_MAX];
+    char text[TEXT_MAX];    // Edit typed
+} FlightEntry;
+
+// Single writer (the thread running the engines); a dump reads whatever
+// is there, an entry being written shows up half filled at worst
+static FlightEntry ring[FLIGHT_ENTRIES];
+static uint32_t head = 0;               // Entries ever started
+static FlightEntry *current = NULL;
+
+static char dump_path[256];
+static char dump_tmp[264];
+static volatile sig_atomic_t dump_requested = 0;
+static char altstack[64 * 1024];
+
+static const char *const action_names[] = {
+    [FLIGHT_KEY] = "key",
+    [FLIGHT_PASS] = "pass",
+    [FLIGHT_RESET] = "reset",
+    [FLIGHT_BACKSPACE] = "backspace",
+    [FLIGHT_TOGGLE] = "toggle",
+    [FLIGHT_TIMEOUT] = "timeout",
+    [FLIGHT_RESYNC] = "resync",
+};
+
+static const char *const change_names[] = {
+    [UNIKEY_TONE] = "tone",
+    [UNIKEY_MARK] = "mark",
+    [UNIKEY_D_STROKE] = "d",
+    [UNIKEY_UNDO] = "undo",
+};
+
+// Copy UTF-8, cut at a character boundary
+static void copy_text(char *dst, const char *src) {
+    size_t n = src ? strlen(src) : 0;
+    if (n >= TEXT_MAX) {
+        n = TEXT_MAX - 1;
+        while (n > 0 && ((unsigned char)src[n] & 0xC0) == 0x80) n--;
+    }
+    memcpy(dst, src ? src : "", n);
+    dst[n] = '\0';
+}
+
+// ============================================================================
+// RECORDING
+// ============================================================================
+
+void flight_begin(int device, int code, unsigned mods, uint64_t event_ns) {
+    FlightEntry *e = &ring[head++ & (FLIGHT_ENTRIES - 1)];
+    memset(e, 0, sizeof(*e));
+    e->start = stats_now();
+    e->event = event_ns;
+    e->code = (uint16_t)code;
+    e->device = (int8_t)device;
+    e->mods = (uint8_t)mods;
+    e->action = FLIGHT_PASS;
+    e->result = -1;
+    current = e;
+}
+
+void flight_action(FlightAction action) {
+    if (current) current->action = (uint8_t)action;
+}
+
+void flight_observe(void *ctx, const UnikeyStep *step) {
+    (void)ctx;
+    FlightEntry *e = current;
+    if (!e) return;
+    e->action = FLIGHT_KEY;
+    e->key = step->key;
+    e->result = (int8_t)step->result;
+    e->n_changes = (uint8_t)step->n_changes;
+    memcpy(e->changes, step->changes, sizeof(e->changes));
+    copy_text(e->before, step->before);
+    copy_text(e->after, step->after);
+}
+
+void flight_edit(int backspaces, const char *text) {
+    if (!current) return;
+    current->backspaces = (uint8_t)(backspaces > 255 ? 255 : backspaces);
+    copy_text(current->text, text);
+}
+
+void flight_end(void) {
+    if (!current) return;
+    current->end = stats_now();
+    current = NULL;
+}
+
+void flight_event(int device, FlightAction action) {
+    flight_begin(device, 0, 0, 0);
+    flight_action(action);
+    flight_end();
+}
+
+// ============================================================================
+// DUMP (async-signal-safe: no stdio, no allocation)
+// ============================================================================
+
+static char out[16 * 1024];
+static size_t out_len;
+static int out_fd;
+
+static void out_flush(void) {
+    size_t off = 0;
+    while (off < out_len) {
+        ssize_t n = write(out_fd, out + off, out_len - off);
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    out_len = 0;
+}
+
+static void put(const char *s, size_t n) {
+    if (out_len + n > sizeof(out)) out_flush();
+    memcpy(out + out_len, s, n);
+    out_len += n;
+}
+
+static void put_str(const char *s) {
+    put(s, strlen(s));
+}
+
+static void put_u64(uint64_t v) {
+    char buf[20];
+    int i = sizeof(buf);
+    do buf[--i] = (char)('0' + v % 10); while ((v /= 10) != 0);
+    put(buf + i, sizeof(buf) - i);
+}
+
+static void put_int(int v) {
+    if (v < 0) {
+        put("-", 1);
+        v = -v;
+    }
+    put_u64((uint64_t)v);
+}
+
+// Nanoseconds as trace microseconds
+static void put_us(uint64_t ns) {
+    static const char digits[] = "0123456789";
+    put_u64(ns / 1000);
+    char frac[4] = {'.', digits[ns / 100 % 10], digits[ns / 10 % 10], digits[ns % 10]};
+    put(frac, sizeof(frac));
+}
+
+// JSON string (input is UTF-8 already)
+static void put_json(const char *s) {
+    put("\"", 1);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char)c};
+            put(esc, 2);
+        } else if (c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            put(esc, 6);
+        } else {
+            put((const char *)&c, 1);
+        }
+    }
+    put("\"", 1);
+}
+
+static void put_codepoint(uint32_t cp) {
+    char buf[3];
+    if (cp < 0x80) {
+        buf[0] = (char)cp;
+        put(buf, 1);
+    } else if (cp < 0x800) {
+        buf[0] = (char)(0xC0 | (cp >> 6));
+        buf[1] = (char)(0x80 | (cp & 0x3F));
+        put(buf, 2);
+    } else {
+        buf[0] = (char)(0xE0 | (cp >> 12));
+        buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (cp & 0x3F));
+        put(buf, 3);
+    }
+}
+
+// One complete ("X") event; the keyboard slot is the thread lane
+static void put_entry(const FlightEntry *e, bool first) {
+    put_str(first ? "\n" : ",\n");
+    put_str("{\"ph\":\"X\",\"pid\":1,\"tid\":");
+    put_int(e->device);
+    put_str(",\"ts\":");
+    put_us(e->start);
+    put_str(",\"dur\":");
+    put_us(e->end > e->start ? e->end - e->start : 0);
+    put_str(",\"cat\":");
+    put_json(action_names[e->action]);
+    put_str(",\"name\":");
+    if (e->key) {
+        char name[2] = {e->key, '\0'};
+        put_json(name);
+    } else {
+        put_json(action_names[e->action]);
+    }
+
+    put_str(",\"args\":{\"code\":");
+    put_int(e->code);
+    if (e->code) {
+        put_str(",\"mods\":\"");
+        if (e->mods & FLIGHT_SHIFT) put_str("shift ");
+        if (e->mods & FLIGHT_CTRL) put_str("ctrl ");
+        if (e->mods & FLIGHT_GRABBED) put_str("grabbed ");
+        put_str(e->mods & FLIGHT_VI ? "vi\"" : "en\"");
+    }
+    if (e->event && e->event <= e->start) {
+        put_str(",\"queued_us\":");
+        put_us(e->start - e->event);
+    }
+    if (e->action == FLIGHT_KEY) {
+        put_str(",\"result\":");
+        put_int(e->result);
+        put_str(",\"before\":");
+        put_json(e->before);
+        put_str(",\"after\":");
+        put_json(e->after);
+        put_str(",\"changes\":[");
+        for (int i = 0; i < e->n_changes && i < 4; i++) {
+            const UnikeyChange *c = &e->changes[i];
+            put_str(i ? ",\"" : "\"");
+            put_str(c->type <= UNIKEY_UNDO && change_names[c->type] ? change_names[c->type] : "?");
+            put_str(" ");
+            put_int(c->pos);
+            put_str(" ");
+            put_codepoint(c->from);
+            put_str(">");
+            put_codepoint(c->to);
+            put_str("\"");
+        }
+        put_str("]");
+    }
+    if (e->backspaces || e->text[0]) {
+        put_str(",\"backspaces\":");
+        put_int(e->backspaces);
+        put_str(",\"text\":");
+        put_json(e->text);
+    }
+    put_str("}}");
+}
+
+void flight_dump(void) {
+    if (!dump_path[0]) return;
+    // The dump holds keystrokes: never write through a link someone else
+    // placed, nor into a file someone else created. A .tmp left by an
+    // interrupted dump is ours to replace
+    int flags = O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC;
+    out_fd = open(dump_tmp, flags, 0600);
+    if (out_fd < 0 && errno == EEXIST && unlink(dump_tmp) == 0) out_fd = open(dump_tmp, flags, 0600);
+    if (out_fd < 0) return;
+
+    out_len = 0;
+    put_str("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    uint32_t end = head;
+    uint32_t begin = end > FLIGHT_ENTRIES ? end - FLIGHT_ENTRIES : 0;
+    for (uint32_t i = begin; i != end; i++) {
+        put_entry(&ring[i & (FLIGHT_ENTRIES - 1)], i == begin);
+    }
+    put_str("\n]}\n");
+    out_flush();
+    close(out_fd);
+    rename(dump_tmp, dump_path);
+}
+
+static void usr2_handler(int sig) {
+    (void)sig;
+    dump_requested = 1;
+}
+
+// Dump, then let the default action (core dump) run
+static void crash_handler(int sig) {
+    flight_dump();
+    raise(sig);
+}
+
+// A directory only we can write to, created if missing
+static bool private_dir(const char *dir) {
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) return false;
+    struct stat st;
+    return lstat(dir, &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == geteuid() &&
+           !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// $XDG_RUNTIME_DIR (per user, 0700), or /run/unikey for a root service
+// started without one; never a shared directory like /tmp
+static bool default_path(char *out, size_t size) {
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (dir && *dir) {
+        snprintf(out, size, "%s/unikey-flight.json", dir);
+        return true;
+    }
+    if (geteuid() == 0 && private_dir(ROOT_DUMP_DIR)) {
+        snprintf(out, size, ROOT_DUMP_DIR "/flight.json");
+        return true;
+    }
+    return false;
+}
+
+void flight_init(const char *path) {
+    dump_path[0] = '\0';
+    if (path) {
+        snprintf(dump_path, sizeof(dump_path), "%s", path);
+    } else if (!default_path(dump_path, sizeof(dump_path))) {
+        fprintf(stderr, "Flight recorder: no private directory for dumps "
+                "(set XDG_RUNTIME_DIR or use --flight FILE)\n");
+    }
+    snprintf(dump_tmp, sizeof(dump_tmp), "%s.tmp", dump_path);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = usr2_handler;
+    sigaction(SIGUSR2, &sa, NULL);
+
+    // Own stack, so a stack overflow still gets its dump
+    stack_t ss = { .ss_sp = altstack, .ss_size = sizeof(altstack) };
+    sigaltstack(&ss, NULL);
+
+    sa.sa_handler = crash_handler;
+    sa.sa_flags = SA_RESETHAND | SA_ONSTACK;
+    static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+        sigaction(crash_signals[i], &sa, NULL);
+    }
+}
+
+void flight_poll(void) {
+    if (!dump_requested) return;
+    dump_requested = 0;
+    flight_dump();
+}
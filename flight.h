@@ -0,0 +1,56 @@
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "unikey.h"
+
+// Flight recorder: the last FLIGHT_ENTRIES key presses with everything the
+// engine decided about them, kept in a static ring (no allocation, always
+// on). Dumped as Chrome trace-event JSON (chrome://tracing, Perfetto) on
+// SIGUSR2 and on a crash
+
+#define FLIGHT_ENTRIES 4096     // Power of two
+
+// What a key press did to the word
+typedef enum {
+    FLIGHT_KEY,         // Letter given to the engine
+    FLIGHT_PASS,        // Left alone (modifier, shortcut)
+    FLIGHT_RESET,       // Word break, Ctrl shortcut
+    FLIGHT_BACKSPACE,
+    FLIGHT_TOGGLE,      // Ctrl+Space, Ctrl+Shift+Space
+    FLIGHT_TIMEOUT,     // Word timeout fired
+    FLIGHT_RESYNC,      // Kernel buffer overflow, events lost
+} FlightAction;
+
+// Modifier bits
+#define FLIGHT_SHIFT    0x01
+#define FLIGHT_CTRL     0x02
+#define FLIGHT_GRABBED  0x04
+#define FLIGHT_VI       0x08
+
+// Install SIGUSR2 and crash handlers; dumps go to path, or with NULL to
+// $XDG_RUNTIME_DIR/unikey-flight.json, /run/unikey/flight.json for root,
+// nowhere if neither is usable
+void flight_init(const char *path);
+
+// Write the dump if SIGUSR2 arrived since the last call (main loop)
+void flight_poll(void);
+
+// Write the dump now (async-signal-safe)
+void flight_dump(void);
+
+// Start an entry for a key press on device (kernel timestamp in ns,
+// 0 = unknown); the calls below fill it in until flight_end()
+void flight_begin(int device, int code, unsigned mods, uint64_t event_ns);
+void flight_action(FlightAction action);
+void flight_edit(int backspaces, const char *text);
+void flight_end(void);
+
+// Record an event that is not a key press (timeout, resync)
+void flight_event(int device, FlightAction action);
+
+// UnikeyObserver: the engine decision for the current entry
+void flight_observe(void *ctx, const UnikeyStep *step);
+
+#endif
@@ -0,0 +1,430 @@
+// Build-time generator for telex_tables.h
+//
+// Usage: ./gen_tables > telex_tables.h
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "telex.h"
+#include "telex_data.h"
+
+#define B(base_row) BASE_INDEX(base_row)
+
+static uint8_t index_lo[VOWEL_INDEX_LO_END];
+static uint8_t index_hi[VOWEL_INDEX_HI_END - VOWEL_INDEX_HI_START];
+static uint8_t key_actions[METHOD_COUNT][128];
+static uint8_t tone_pos[NUCLEUS_COUNT];
+static uint8_t horn[BASE_COUNT];
+static uint8_t doubled[BASE_COUNT][BASE_COUNT];
+static uint16_t uow[BASE_COUNT * BASE_COUNT];
+static uint8_t marks[MARK_COUNT][BASE_COUNT];
+static EncodedChar enc_vowels[ENC_COUNT][VOWEL_ROWS * 6];
+static EncodedChar enc_dd[ENC_COUNT][2];
+static uint8_t enc_max_units[ENC_COUNT];
+
+static void emit_bytes(const char *name, const uint8_t *data, int n) {
+    printf("static const uint8_t %s[%d] = {", name, n);
+    for (int i = 0; i < n; i++) {
+        if (i % 16 == 0) printf("\n   ");
+        printf(" 0x%02X,", data[i]);
+    }
+    printf("\n};\n\n");
+}
+
+static void emit_words(const char *name, const uint16_t *data, int n) {
+    printf("static const uint16_t %s[%d] = {", name, n);
+    for (int i = 0; i < n; i++) {
+        if (i % 12 == 0) printf("\n   ");
+        printf(" 0x%04X,", data[i]);
+    }
+    printf("\n};\n\n");
+}
+
+// Codepoint -> packed (row, tone), VOWEL_NONE for non-vowels
+static int gen_vowel_index(void) {
+    memset(index_lo, VOWEL_NONE, sizeof(index_lo));
+    memset(index_hi, VOWEL_NONE, sizeof(index_hi));
+
+    for (int row = 0; row < VOWEL_ROWS; row++) {
+        for (int tone = 0; tone < 6; tone++) {
+            uint32_t cp = vowel_table[row][tone];
+            uint8_t *slot;
+            if (cp < VOWEL_INDEX_LO_END) {
+                slot = &index_lo[cp];
+            } else if (cp >= VOWEL_INDEX_HI_START && cp < VOWEL_INDEX_HI_END) {
+                slot = &index_hi[cp - VOWEL_INDEX_HI_START];
+            } else {
+                fprintf(stderr, "gen_tables: U+%04X outside vowel index\n", cp);
+                return -1;
+            }
+            *slot = VI_PACK(row, tone);
+        }
+    }
+
+    printf("// Vowel index: codepoint -> VI_PACK(row, tone)\n");
+    emit_bytes("vowel_index_lo", index_lo, (int)sizeof(index_lo));
+    emit_bytes("vowel_index_hi", index_hi, (int)sizeof(index_hi));
+    return 0;
+}
+
+typedef struct {
+    char key;
+    uint8_t action;
+} KeyAction;
+
+// Input method keys -> action; letters in both cases
+static void gen_key_actions(void) {
+    static const KeyAction telex[] = {
+        {'s', ACT_TONE | 1}, {'f', ACT_TONE | 2}, {'r', ACT_TONE | 3},
+        {'x', ACT_TONE | 4}, {'j', ACT_TONE | 5}, {'z', ACT_TONE | 0},
+        {'a', ACT_DOUBLE | B(BASE_A)}, {'e', ACT_DOUBLE | B(BASE_E)},
+        {'o', ACT_DOUBLE | B(BASE_O)},
+        {'w', ACT_HORN}, {'d', ACT_STROKE},
+    };
+    static const KeyAction vni[] = {
+        {'1', ACT_TONE | 1}, {'2', ACT_TONE | 2}, {'3', ACT_TONE | 3},
+        {'4', ACT_TONE | 4}, {'5', ACT_TONE | 5}, {'0', ACT_TONE | 0},
+        {'6', ACT_MARK | MARK_HAT}, {'7', ACT_MARK | MARK_HORN},
+        {'8', ACT_MARK | MARK_BREVE}, {'9', ACT_STROKE},
+    };
+    static const KeyAction viqr[] = {
+        {'\'', ACT_TONE | 1}, {'`', ACT_TONE | 2}, {'?', ACT_TONE | 3},
+        {'~', ACT_TONE | 4}, {'.', ACT_TONE | 5},
+        {'^', ACT_MARK | MARK_HAT}, {'+', ACT_MARK | MARK_HORN},
+        {'(', ACT_MARK | MARK_BREVE}, {'d', ACT_STROKE | 1},
+    };
+    static const struct { const KeyAction *keys; size_t n; } methods[METHOD_COUNT] = {
+        [METHOD_TELEX] = { telex, sizeof(telex) / sizeof(telex[0]) },
+        [METHOD_VNI] = { vni, sizeof(vni) / sizeof(vni[0]) },
+        [METHOD_VIQR] = { viqr, sizeof(viqr) / sizeof(viqr[0]) },
+    };
+
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        for (size_t i = 0; i < methods[m].n; i++) {
+            char key = methods[m].keys[i].key;
+            key_actions[m][(int)key] = methods[m].keys[i].action;
+            if (key >= 'a' && key <= 'z') key_actions[m][key - 32] = methods[m].keys[i].action;
+        }
+    }
+
+    printf("// [InputMethod][key] -> ACT_* action\n");
+    printf("static const uint8_t key_actions[%d][128] = {\n", METHOD_COUNT);
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        printf("  {");
+        for (int i = 0; i < 128; i++) {
+            if (i % 16 == 0) printf("\n   ");
+            printf(" 0x%02X,", key_actions[m][i]);
+        }
+        printf("\n  },\n");
+    }
+    printf("};\n\n");
+}
+
+static inline bool base_in(int b, const int *set, int n) {
+    for (int i = 0; i < n; i++) if (B(set[i]) == b) return true;
+    return false;
+}
+
+// Tone offset inside a vowel nucleus (Vietnamese rules + freedom typing)
+static int nucleus_tone_offset(const int *b, int len, bool final_cons) {
+    // Priority: ơ, ê get the tone
+    for (int i = 0; i < len; i++) {
+        if (b[i] == B(BASE_OW) || b[i] == B(BASE_EE)) return i;
+    }
+
+    if (len == 2) {
+        static const int o_like[] = {BASE_O, BASE_OO, BASE_OW};
+        static const int after_o[] = {BASE_A, BASE_AW, BASE_AA, BASE_E, BASE_EE};
+        static const int u_like[] = {BASE_U, BASE_UW};
+        static const int after_u[] = {BASE_Y, BASE_E, BASE_EE, BASE_OW, BASE_A};
+
+        // oa, oe, uy patterns -> second vowel
+        if (base_in(b[0], o_like, 3) && base_in(b[1], after_o, 5)) return 1;
+        if (base_in(b[0], u_like, 2) && base_in(b[1], after_u, 5)) return 1;
+        return final_cons ? 1 : 0;
+    }
+
+    return len >= 3 ? 1 : 0;
+}
+
+// Nucleus id -> tone offset: low nibble open syllable, high nibble with final consonant
+static void gen_tone_positions(void) {
+    int b[NUCLEUS_MAX_LEN];
+
+    for (b[0] = 0; b[0] < BASE_COUNT; b[0]++) {
+        tone_pos[NUCLEUS_ID1(b[0])] = (uint8_t)(nucleus_tone_offset(b, 1, false) |
+                                                (nucleus_tone_offset(b, 1, true) << 4));
+        for (b[1] = 0; b[1] < BASE_COUNT; b[1]++) {
+            tone_pos[NUCLEUS_ID2(b[0], b[1])] =
+                (uint8_t)(nucleus_tone_offset(b, 2, false) |
+                          (nucleus_tone_offset(b, 2, true) << 4));
+            for (b[2] = 0; b[2] < BASE_COUNT; b[2]++) {
+                tone_pos[NUCLEUS_ID3(b[0], b[1], b[2])] =
+                    (uint8_t)(nucleus_tone_offset(b, 3, false) |
+                              (nucleus_tone_offset(b, 3, true) << 4));
+            }
+        }
+    }
+
+    printf("// Vowel nucleus -> tone offset (low: open, high: final consonant)\n");
+    emit_bytes("tone_pos_table", tone_pos, (int)sizeof(tone_pos));
+}
+
+// Mark transitions: (key, base) -> new base
+static void gen_mark_transitions(void) {
+    static const int horn_pairs[][2] = {
+        {BASE_A, BASE_AW}, {BASE_O, BASE_OW}, {BASE_U, BASE_UW},
+    };
+    static const int double_pairs[][2] = {
+        {BASE_A, BASE_AA}, {BASE_E, BASE_EE}, {BASE_O, BASE_OO},
+    };
+
+    memset(horn, BASE_NONE, sizeof(horn));
+    memset(doubled, BASE_NONE, sizeof(doubled));
+
+    for (int i = 0; i < 3; i++) {
+        int plain = B(horn_pairs[i][0]), marked = B(horn_pairs[i][1]);
+        horn[plain] = (uint8_t)marked;
+        horn[marked] = (uint8_t)plain;
+
+        plain = B(double_pairs[i][0]);
+        marked = B(double_pairs[i][1]);
+        doubled[plain][plain] = (uint8_t)marked;
+        doubled[plain][marked] = (uint8_t)plain;
+    }
+
+    // UOW shortcut on the last two vowels: uo/ưo/uơ -> ươ, ươ -> uo (undo)
+    int u = B(BASE_U), uw = B(BASE_UW), o = B(BASE_O), ow = B(BASE_OW);
+    uow[u * BASE_COUNT + o]   = UOW_VALID | (uw << 4) | ow;
+    uow[uw * BASE_COUNT + o]  = UOW_VALID | (uw << 4) | ow;
+    uow[u * BASE_COUNT + ow]  = UOW_VALID | (uw << 4) | ow;
+    uow[uw * BASE_COUNT + ow] = UOW_VALID | UOW_UNDO | (u << 4) | o;
+
+    // Mark keys: put the mark on, switch from another one, or take it off
+    static const int mark_pairs[][3] = {
+        {MARK_HAT, BASE_A, BASE_AA}, {MARK_HAT, BASE_AW, BASE_AA},
+        {MARK_HAT, BASE_E, BASE_EE}, {MARK_HAT, BASE_O, BASE_OO}, {MARK_HAT, BASE_OW, BASE_OO},
+        {MARK_BREVE, BASE_A, BASE_AW}, {MARK_BREVE, BASE_AA, BASE_AW},
+        {MARK_HORN, BASE_O, BASE_OW}, {MARK_HORN, BASE_OO, BASE_OW}, {MARK_HORN, BASE_U, BASE_UW},
+    };
+    static const int plain[] = {BASE_A, BASE_E, BASE_O, BASE_U};
+    memset(marks, BASE_NONE, sizeof(marks));
+    for (size_t i = 0; i < sizeof(mark_pairs) / sizeof(mark_pairs[0]); i++) {
+        int mark = mark_pairs[i][0], from = B(mark_pairs[i][1]), to = B(mark_pairs[i][2]);
+        marks[mark][from] = (uint8_t)to;
+        // Pressed again, the key goes back to the plain vowel
+        if (base_in(from, plain, 4)) marks[mark][to] = (uint8_t)(from | MARK_UNDO);
+    }
+
+    printf("// w: base -> base with/without breve or horn\n");
+    emit_bytes("horn_table", horn, (int)sizeof(horn));
+    printf("// aa/ee/oo: [doubled vowel * BASE_COUNT + base] -> base with/without circumflex\n");
+    emit_bytes("double_table", &doubled[0][0], (int)sizeof(doubled));
+    printf("// w on a vowel pair: [b1 * BASE_COUNT + b2] -> UOW_* transition\n");
+    emit_words("uow_table", uow, BASE_COUNT * BASE_COUNT);
+    printf("// Mark keys: [MARK_* * BASE_COUNT + base] -> new base (| MARK_UNDO)\n");
+    emit_bytes("mark_table", &marks[0][0], (int)sizeof(marks));
+}
+
+// Legacy charsets: one byte per vowel, [row][tone]. TCVN3 has no capital
+// toned vowels (.VnXxxH fonts draw the small ones as capitals)
+static const uint8_t tcvn3[VOWEL_ROWS][6] = {
+    {0x61, 0xB8, 0xB5, 0xB6, 0xB7, 0xB9},  // a
+    {0x41, 0xB8, 0xB5, 0xB6, 0xB7, 0xB9},  // A
+    {0xA8, 0xBE, 0xBB, 0xBC, 0xBD, 0xC6},  // ă
+    {0xA1, 0xBE, 0xBB, 0xBC, 0xBD, 0xC6},  // Ă
+    {0xA9, 0xCA, 0xC7, 0xC8, 0xC9, 0xCB},  // â
+    {0xA2, 0xCA, 0xC7, 0xC8, 0xC9, 0xCB},  // Â
+    {0x65, 0xD0, 0xCC, 0xCE, 0xCF, 0xD1},  // e
+    {0x45, 0xD0, 0xCC, 0xCE, 0xCF, 0xD1},  // E
+    {0xAA, 0xD5, 0xD2, 0xD3, 0xD4, 0xD6},  // ê
+    {0xA3, 0xD5, 0xD2, 0xD3, 0xD4, 0xD6},  // Ê
+    {0x69, 0xDD, 0xD7, 0xD8, 0xDC, 0xDE},  // i
+    {0x49, 0xDD, 0xD7, 0xD8, 0xDC, 0xDE},  // I
+    {0x6F, 0xE3, 0xDF, 0xE1, 0xE2, 0xE4},  // o
+    {0x4F, 0xE3, 0xDF, 0xE1, 0xE2, 0xE4},  // O
+    {0xAB, 0xE8, 0xE5, 0xE6, 0xE7, 0xE9},  // ô
+    {0xA4, 0xE8, 0xE5, 0xE6, 0xE7, 0xE9},  // Ô
+    {0xAC, 0xED, 0xEA, 0xEB, 0xEC, 0xEE},  // ơ
+    {0xA5, 0xED, 0xEA, 0xEB, 0xEC, 0xEE},  // Ơ
+    {0x75, 0xF3, 0xEF, 0xF1, 0xF2, 0xF4},  // u
+    {0x55, 0xF3, 0xEF, 0xF1, 0xF2, 0xF4},  // U
+    {0xAD, 0xF8, 0xF5, 0xF6, 0xF7, 0xF9},  // ư
+    {0xA6, 0xF8, 0xF5, 0xF6, 0xF7, 0xF9},  // Ư
+    {0x79, 0xFD, 0xFA, 0xFB, 0xFC, 0xFE},  // y
+    {0x59, 0xFD, 0xFA, 0xFB, 0xFC, 0xFE},  // Y
+};
+
+// VISCII (RFC 1456): all 134 letters, six capitals on C0 control codes
+static const uint8_t viscii[VOWEL_ROWS][6] = {
+    {0x61, 0xE1, 0xE0, 0xE4, 0xE3, 0xD5},  // a
+    {0x41, 0xC1, 0xC0, 0xC4, 0xC3, 0x80},  // A
+    {0xE5, 0xA1, 0xA2, 0xC6, 0xC7, 0xA3},  // ă
+    {0xC5, 0x81, 0x82, 0x02, 0x05, 0x83},  // Ă
+    {0xE2, 0xA4, 0xA5, 0xA6, 0xE7, 0xA7},  // â
+    {0xC2, 0x84, 0x85, 0x86, 0x06, 0x87},  // Â
+    {0x65, 0xE9, 0xE8, 0xEB, 0xA8, 0xA9},  // e
+    {0x45, 0xC9, 0xC8, 0xCB, 0x88, 0x89},  // E
+    {0xEA, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE},  // ê
+    {0xCA, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E},  // Ê
+    {0x69, 0xED, 0xEC, 0xEF, 0xEE, 0xB8},  // i
+    {0x49, 0xCD, 0xCC, 0x9B, 0xCE, 0x98},  // I
+    {0x6F, 0xF3, 0xF2, 0xF6, 0xF5, 0xF7},  // o
+    {0x4F, 0xD3, 0xD2, 0x99, 0xA0, 0x9A},  // O
+    {0xF4, 0xAF, 0xB0, 0xB1, 0xB2, 0xB5},  // ô
+    {0xD4, 0x8F, 0x90, 0x91, 0x92, 0x93},  // Ô
+    {0xBD, 0xBE, 0xB6, 0xB7, 0xDE, 0xFE},  // ơ
+    {0xB4, 0x95, 0x96, 0x97, 0xB3, 0x94},  // Ơ
+    {0x75, 0xFA, 0xF9, 0xFC, 0xFB, 0xF8},  // u
+    {0x55, 0xDA, 0xD9, 0x9C, 0x9D, 0x9E},  // U
+    {0xDF, 0xD1, 0xD7, 0xD8, 0xE6, 0xF1},  // ư
+    {0xBF, 0xBA, 0xBB, 0xBC, 0xFF, 0xB9},  // Ư
+    {0x79, 0xFD, 0xCF, 0xD6, 0xDB, 0xDC},  // y
+    {0x59, 0xDD, 0x9F, 0x14, 0x19, 0x1E},  // Y
+};
+
+static void enc_push(EncodedChar *e, uint32_t cp) {
+    char *p = e->utf8 + e->len;
+    if (cp < 0x80) {
+        p[0] = (char)cp;
+        e->len += 1;
+    } else if (cp < 0x800) {
+        p[0] = (char)(0xC0 | (cp >> 6));
+        p[1] = (char)(0x80 | (cp & 0x3F));
+        e->len += 2;
+    } else {
+        p[0] = (char)(0xE0 | (cp >> 12));
+        p[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        p[2] = (char)(0x80 | (cp & 0x3F));
+        e->len += 3;
+    }
+    e->units++;
+}
+
+#define COMBINING_HORN      0x031B
+#define COMBINING_DOT_BELOW 0x0323
+
+// NFD: letter, then the marks in canonical order (horn, dot below, the rest
+// as typed: circumflex or breve before the tone)
+static void encode_nfd(EncodedChar *e, char letter, uint32_t mark, int tone) {
+    static const uint32_t tones[6] = {0, 0x0301, 0x0300, 0x0309, 0x0303, COMBINING_DOT_BELOW};
+    enc_push(e, (uint8_t)letter);
+    if (mark == COMBINING_HORN) enc_push(e, mark);
+    if (tone == 5) enc_push(e, COMBINING_DOT_BELOW);
+    if (mark && mark != COMBINING_HORN) enc_push(e, mark);
+    if (tone && tone != 5) enc_push(e, tones[tone]);
+}
+
+// VNI-Windows: letter + mark byte, capitals with the capital mark byte
+// (0x20 lower). ơ ư í ì ỉ ĩ ị ỵ are single bytes
+static void encode_vni(EncodedChar *e, int base, char letter, bool upper, int tone) {
+    static const uint8_t tones[6] = {0, 0xF9, 0xF8, 0xFB, 0xF5, 0xEF};
+    static const uint8_t hat[6] = {0xE2, 0xE1, 0xE0, 0xE5, 0xE3, 0xE4};
+    static const uint8_t breve[6] = {0xEA, 0xE9, 0xE8, 0xFA, 0xFC, 0xEB};
+    static const uint8_t i_tones[6] = {'i', 0xED, 0xEC, 0xE6, 0xF3, 0xF2};
+    int caps = upper ? 0x20 : 0;
+
+    switch (base) {
+        case BASE_I:
+            enc_push(e, i_tones[tone] - caps);
+            return;
+        case BASE_Y:
+            if (tone == 5) {
+                enc_push(e, 0xEE - caps);
+                return;
+            }
+            break;
+        case BASE_OW:
+        case BASE_UW:
+            enc_push(e, (base == BASE_OW ? 0xF4 : 0xF6) - caps);
+            if (tone) enc_push(e, tones[tone] - caps);
+            return;
+        case BASE_AA:
+        case BASE_EE:
+        case BASE_OO:
+            enc_push(e, (uint8_t)letter);
+            enc_push(e, hat[tone] - caps);
+            return;
+        case BASE_AW:
+            enc_push(e, (uint8_t)letter);
+            enc_push(e, breve[tone] - caps);
+            return;
+    }
+    enc_push(e, (uint8_t)letter);
+    if (tone) enc_push(e, tones[tone] - caps);
+}
+
+static void emit_encoded(const char *name, const EncodedChar *data, int rows, int n) {
+    printf("static const EncodedChar %s[%d][%d] = {\n", name, rows, n);
+    for (int r = 0; r < rows; r++) {
+        printf("  {");
+        for (int i = 0; i < n; i++) {
+            const EncodedChar *e = &data[r * n + i];
+            if (i % 6 == 0) printf("\n   ");
+            printf(" {\"");
+            for (int b = 0; b < e->len; b++) printf("\\x%02X", (uint8_t)e->utf8[b]);
+            printf("\", %d, %d},", e->len, e->units);
+        }
+        printf("\n  },\n");
+    }
+    printf("};\n\n");
+}
+
+// Output encodings of every vowel and đ
+static void gen_encodings(void) {
+    // Letter and combining mark of each base
+    static const struct { char letter; uint32_t mark; } bases[BASE_COUNT] = {
+        {'a', 0}, {'a', 0x0306}, {'a', 0x0302}, {'e', 0}, {'e', 0x0302}, {'i', 0},
+        {'o', 0}, {'o', 0x0302}, {'o', COMBINING_HORN}, {'u', 0}, {'u', COMBINING_HORN}, {'y', 0},
+    };
+
+    for (int row = 0; row < VOWEL_ROWS; row++) {
+        int base = row & ~1;
+        bool upper = row & 1;
+        char letter = (char)(bases[B(base)].letter - (upper ? 32 : 0));
+        for (int tone = 0; tone < 6; tone++) {
+            EncodedChar *e = &enc_vowels[0][row * 6 + tone];
+            enc_push(&e[ENC_UNICODE * VOWEL_ROWS * 6], vowel_table[row][tone]);
+            encode_nfd(&e[ENC_NFD * VOWEL_ROWS * 6], letter, bases[B(base)].mark, tone);
+            enc_push(&e[ENC_TCVN3 * VOWEL_ROWS * 6], tcvn3[row][tone]);
+            encode_vni(&e[ENC_VNI_WIN * VOWEL_ROWS * 6], base, letter, upper, tone);
+            enc_push(&e[ENC_VISCII * VOWEL_ROWS * 6], viscii[row][tone]);
+        }
+    }
+
+    // đ, Đ
+    static const uint32_t dd[ENC_COUNT][2] = {
+        [ENC_UNICODE] = {0x0111, 0x0110}, [ENC_NFD] = {0x0111, 0x0110},
+        [ENC_TCVN3] = {0xAE, 0xA7}, [ENC_VNI_WIN] = {0xF1, 0xD1}, [ENC_VISCII] = {0xF0, 0xD0},
+    };
+    for (int enc = 0; enc < ENC_COUNT; enc++) {
+        enc_push(&enc_dd[enc][0], dd[enc][0]);
+        enc_push(&enc_dd[enc][1], dd[enc][1]);
+        enc_max_units[enc] = 1;
+        for (int i = 0; i < VOWEL_ROWS * 6; i++) {
+            if (enc_vowels[enc][i].units > enc_max_units[enc]) enc_max_units[enc] = enc_vowels[enc][i].units;
+        }
+    }
+
+    printf("// [TextEncoding][row * 6 + tone] -> encoded vowel\n");
+    emit_encoded("enc_vowels", &enc_vowels[0][0], ENC_COUNT, VOWEL_ROWS * 6);
+    printf("// [TextEncoding][capital] -> encoded đ\n");
+    emit_encoded("enc_dd", &enc_dd[0][0], ENC_COUNT, 2);
+    printf("// Most codepoints one character takes\n");
+    emit_bytes("enc_max_units", enc_max_units, ENC_COUNT);
+}
+
+int main(void) {
+    printf("// Generated by gen_tables.c - do not edit\n");
+    printf("#ifndef TELEX_TABLES_H\n#define TELEX_TABLES_H\n\n");
+    printf("#include <stdint.h>\n\n");
+
+    if (gen_vowel_index() < 0) return 1;
+    gen_key_actions();
+    gen_tone_positions();
+    gen_mark_transitions();
+    gen_encodings();
+
+    printf("#endif\n");
+    return 0;
+}
@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include "im.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Wire format: every message is [object id][size << 16 | opcode] followed
+// by its arguments, each 32-bit aligned; a string is its length with the
+// NUL, then the bytes padded to 4. Ids below are the ones we allocate
+#define DISPLAY_ID 1
+
+// wl_display
+#define DISPLAY_SYNC            0
+#define DISPLAY_GET_REGISTRY    1
+#define DISPLAY_ERROR           0
+// wl_registry
+#define REGISTRY_BIND           0
+#define REGISTRY_GLOBAL         0
+// wl_callback
+#define CALLBACK_DONE           0
+// zwp_input_method_manager_v2
+#define MANAGER_GET_INPUT_METHOD 0
+// zwp_input_method_v2
+#define IM_COMMIT_STRING        0
+#define IM_DELETE_SURROUNDING   2
+#define IM_COMMIT               3
+#define IM_DESTROY              6
+#define IM_ACTIVATE             0
+#define IM_DEACTIVATE           1
+#define IM_DONE                 5
+#define IM_UNAVAILABLE          6
+
+#define SHADOW_CHARS 64
+
+static int sock = -1;
+static uint32_t next_id = DISPLAY_ID + 1;
+static uint32_t registry_id, seat_id, manager_id, im_id, sync_id;
+static uint32_t seat_name, manager_name;       // Registry globals, 0 = none
+static bool sync_done = false;
+
+// Activation is double-buffered: it takes effect at the next done event,
+// whose count is the serial every commit must carry
+static bool pending_active = false, im_active = false;
+static uint32_t serial = 0;
+static bool warned_inactive = false;
+
+// UTF-8 length of the last characters in the text field, newest last:
+// delete_surrounding_text counts bytes, edits count characters. Keys typed
+// before we saw them are ASCII
+static uint8_t shadow[SHADOW_CHARS];
+static int shadow_len = 0;
+
+static uint32_t out[1024];
+static int out_len = 0;                 // Words
+static char in[8192];
+static size_t in_len = 0;
+
+// ============================================================================
+// WIRE PROTOCOL
+// ============================================================================
+
+static void msg_begin(uint32_t id, uint32_t opcode) {
+    out[out_len++] = id;
+    out[out_len++] = opcode;            // Size filled in by msg_end()
+}
+
+static void msg_uint(uint32_t v) {
+    out[out_len++] = v;
+}
+
+static void msg_string(const char *s) {
+    uint32_t n = (uint32_t)strlen(s) + 1;
+    out[out_len++] = n;
+    memset(&out[out_len], 0, (n + 3) & ~3u);
+    memcpy(&out[out_len], s, n);
+    out_len += (int)((n + 3) / 4);
+}
+
+static void msg_end(int start) {
+    out[start + 1] |= (uint32_t)(out_len - start) * 4 << 16;
+}
+
+static int flush_out(void) {
+    const char *p = (const char *)out;
+    size_t left = (size_t)out_len * 4;
+    out_len = 0;
+    while (left > 0) {
+        ssize_t n = send(sock, p, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            perror("wayland");
+            return -1;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    return 0;
+}
+
+static void send_sync(void) {
+    int start = out_len;
+    sync_id = next_id++;
+    sync_done = false;
+    msg_begin(DISPLAY_ID, DISPLAY_SYNC);
+    msg_uint(sync_id);
+    msg_end(start);
+}
+
+static void send_bind(uint32_t name, const char *interface, uint32_t version, uint32_t id) {
+    int start = out_len;
+    msg_begin(registry_id, REGISTRY_BIND);
+    msg_uint(name);
+    msg_string(interface);
+    msg_uint(version);
+    msg_uint(id);
+    msg_end(start);
+}
+
+// String argument at *off, NULL if malformed
+static const char *arg_string(const char *body, size_t size, size_t *off) {
+    if (*off + 4 > size) return NULL;
+    uint32_t n;
+    memcpy(&n, body + *off, 4);
+    *off += 4;
+    if (n == 0 || *off + n > size || body[*off + n - 1] != '\0') return NULL;
+    const char *s = body + *off;
+    *off += (n + 3) & ~3u;
+    return s;
+}
+
+static uint32_t arg_uint(const char *body, size_t size, size_t *off) {
+    uint32_t v = 0;
+    if (*off + 4 <= size) memcpy(&v, body + *off, 4);
+    *off += 4;
+    return v;
+}
+
+static void handle_event(uint32_t id, uint32_t opcode, const char *body, size_t size) {
+    size_t off = 0;
+    if (id == DISPLAY_ID && opcode == DISPLAY_ERROR) {
+        uint32_t object = arg_uint(body, size, &off);
+        uint32_t code = arg_uint(body, size, &off);
+        const char *msg = arg_string(body, size, &off);
+        fprintf(stderr, "wayland: error %u on object %u: %s\n", code, object, msg ? msg : "");
+        im_close();
+    } else if (id == registry_id && opcode == REGISTRY_GLOBAL) {
+        uint32_t name = arg_uint(body, size, &off);
+        const char *interface = arg_string(body, size, &off);
+        if (!interface) return;
+        if (!seat_name && strcmp(interface, "wl_seat") == 0) seat_name = name;
+        if (strcmp(interface, "zwp_input_method_manager_v2") == 0) manager_name = name;
+    } else if (id == sync_id && opcode == CALLBACK_DONE) {
+        sync_done = true;
+    } else if (id == im_id) {
+        switch (opcode) {
+            case IM_ACTIVATE:
+                // Sent on every focus change, also from one text field to
+                // another while active: what we typed is in the old field
+                pending_active = true;
+                shadow_len = 0;
+                break;
+            case IM_DEACTIVATE: pending_active = false; break;
+            case IM_DONE:
+                if (pending_active != im_active) shadow_len = 0;
+                im_active = pending_active;
+                serial++;
+                break;
+            case IM_UNAVAILABLE:
+                fprintf(stderr, "wayland: another input method is running\n");
+                im_close();
+                break;
+            default: break;     // surrounding_text, content_type, ...
+        }
+    }
+    // Seat events and delete_id need nothing
+}
+
+// Read what the socket has; -1 on hang-up or a broken message
+static int read_events(void) {
+    for (;;) {
+        ssize_t n = recv(sock, in + in_len, sizeof(in) - in_len, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) {
+            fprintf(stderr, "wayland: compositor closed the connection\n");
+            im_close();
+            return -1;
+        }
+        in_len += (size_t)n;
+
+        size_t pos = 0;
+        while (in_len - pos >= 8) {
+            uint32_t hdr[2];
+            memcpy(hdr, in + pos, 8);
+            size_t size = hdr[1] >> 16;
+            if (size < 8 || size > sizeof(in) || (size & 3)) {
+                fprintf(stderr, "wayland: bad message size %zu\n", size);
+                im_close();
+                return -1;
+            }
+            if (in_len - pos < size) break;
+            handle_event(hdr[0], hdr[1] & 0xFFFF, in + pos + 8, size - 8);
+            if (sock < 0) return -1;
+            pos += size;
+        }
+        memmove(in, in + pos, in_len - pos);
+        in_len -= pos;
+    }
+}
+
+// Send what is queued and wait for the compositor to answer all of it
+static int roundtrip(void) {
+    send_sync();
+    if (flush_out() < 0) return -1;
+    while (!sync_done) {
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        int rc = poll(&pfd, 1, 1000);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) {
+            fprintf(stderr, "wayland: compositor not answering\n");
+            return -1;
+        }
+        if (read_events() < 0) return -1;
+    }
+    return 0;
+}
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+static int connect_display(void) {
+    const char *name = getenv("WAYLAND_DISPLAY");
+    if (!name || !*name) name = "wayland-0";
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int len;
+    if (name[0] == '/') {
+        len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", name);
+    } else {
+        const char *dir = getenv("XDG_RUNTIME_DIR");
+        if (!dir || !*dir) {
+            fprintf(stderr, "wayland: XDG_RUNTIME_DIR is not set\n");
+            return -1;
+        }
+        len = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s", dir, name);
+    }
+    if (len < 0 || len >= (int)sizeof(addr.sun_path)) {
+        fprintf(stderr, "wayland: socket path too long\n");
+        return -1;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(addr.sun_path);
+        if (sock >= 0) close(sock);
+        sock = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int im_open(void) {
+    next_id = DISPLAY_ID + 1;
+    registry_id = seat_id = manager_id = im_id = sync_id = 0;
+    seat_name = manager_name = 0;
+    pending_active = im_active = false;
+    serial = 0;
+    warned_inactive = false;
+    shadow_len = 0;
+    out_len = 0;
+    in_len = 0;
+    if (connect_display() < 0) return -1;
+
+    int start = out_len;
+    registry_id = next_id++;
+    msg_begin(DISPLAY_ID, DISPLAY_GET_REGISTRY);
+    msg_uint(registry_id);
+    msg_end(start);
+    if (roundtrip() < 0) goto fail;
+    if (!seat_name || !manager_name) {
+        fprintf(stderr, "wayland: compositor has no %s\n",
+                seat_name ? "zwp_input_method_manager_v2" : "wl_seat");
+        goto fail;
+    }
+
+    seat_id = next_id++;
+    send_bind(seat_name, "wl_seat", 1, seat_id);
+    manager_id = next_id++;
+    send_bind(manager_name, "zwp_input_method_manager_v2", 1, manager_id);
+    start = out_len;
+    im_id = next_id++;
+    msg_begin(manager_id, MANAGER_GET_INPUT_METHOD);
+    msg_uint(seat_id);
+    msg_uint(im_id);
+    msg_end(start);
+    // unavailable, if another input method holds the seat, comes back here
+    if (roundtrip() < 0) goto fail;
+    return 0;
+
+fail:
+    im_close();
+    return -1;
+}
+
+void im_close(void) {
+    if (sock < 0) return;
+    if (im_id) {
+        out_len = 0;
+        int start = out_len;
+        msg_begin(im_id, IM_DESTROY);
+        msg_end(start);
+        send(sock, out, (size_t)out_len * 4, MSG_NOSIGNAL | MSG_DONTWAIT);
+        out_len = 0;
+        im_id = 0;
+    }
+    close(sock);
+    sock = -1;
+}
+
+int im_fd(void) {
+    return sock;
+}
+
+void im_dispatch(void) {
+    if (sock >= 0) read_events();
+}
+
+static void shadow_push(uint8_t bytes) {
+    if (shadow_len == SHADOW_CHARS) {
+        memmove(shadow, shadow + 1, SHADOW_CHARS - 1);
+        shadow_len--;
+    }
+    shadow[shadow_len++] = bytes;
+}
+
+void im_replace(int bs_count, const char *text) {
+    im_dispatch();
+    if (sock < 0) return;
+    if (!im_active) {
+        if (!warned_inactive) fprintf(stderr, "wayland: no text field with text-input, edit dropped\n");
+        warned_inactive = true;
+        return;
+    }
+
+    uint32_t bytes = 0;
+    for (int i = 0; i < bs_count; i++) {
+        bytes += shadow_len > 0 ? shadow[--shadow_len] : 1;
+    }
+    int start = out_len;
+    if (bytes > 0) {
+        msg_begin(im_id, IM_DELETE_SURROUNDING);
+        msg_uint(bytes);
+        msg_uint(0);
+        msg_end(start);
+    }
+    if (text && *text) {
+        start = out_len;
+        msg_begin(im_id, IM_COMMIT_STRING);
+        msg_string(text);
+        msg_end(start);
+        for (const char *p = text; *p;) {
+            uint8_t n = 1;
+            while ((p[n] & 0xC0) == 0x80) n++;
+            shadow_push(n);
+            p += n;
+        }
+    }
+    start = out_len;
+    msg_begin(im_id, IM_COMMIT);
+    msg_uint(serial);
+    msg_end(start);
+    stats_mark(STAT_ENCODE);
+
+    if (flush_out() < 0) im_close();
+    stats_mark(STAT_SUBMIT);
+}
+
+void im_typed(uint32_t cp) {
+    if (cp == '\b') {
+        if (shadow_len > 0) shadow_len--;
+    } else if (cp == 0) {
+        shadow_len = 0;
+    } else {
+        shadow_push(cp < 0x80 ? 1 : cp < 0x800 ? 2 : 3);
+    }
+}
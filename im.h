@@ -0,0 +1,30 @@
+#ifndef IM_H
+#define IM_H
+
+#include <stdint.h>
+
+// Wayland input method (zwp_input_method_v2), spoken directly on the
+// compositor socket without libwayland. Each edit is one
+// delete_surrounding_text + commit_string + commit, applied atomically by
+// the compositor to the focused text field (text-input-v3)
+
+// Connect, bind the seat and register as the input method
+int im_open(void);
+
+// Cleanup
+void im_close(void);
+
+// Socket to poll for compositor events, -1 if closed
+int im_fd(void);
+
+// Read and handle pending compositor events (never blocks)
+void im_dispatch(void);
+
+// Delete bs_count characters before the cursor, then insert UTF-8 text
+void im_replace(int bs_count, const char *text);
+
+// A key reached the text field without us: its character, '\b' for
+// backspace, 0 for anything else (cursor may have moved)
+void im_typed(uint32_t cp);
+
+#endif
@@ -1,6 +1,12 @@
 #define _GNU_SOURCE
 #include "keyboard.h"
-#include "telex.h"
+#include "unikey.h"
+#include "output.h"
+#include "replay.h"
+#include "device.h"
+#include "stats.h"
+#include "flight.h"
+#include "keymap.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,180 +15,445 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
-#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <sys/ioctl.h>
 #include <linux/input.h>
 #include <libevdev/libevdev.h>
+#include <libevdev/libevdev-uinput.h>
 
-static struct libevdev *dev = NULL;
-static int fd = -1;
+#define MAX_DEVICES 16
+#define INPUT_DIR "/dev/input"
+#define INOTIFY_TAG 0xFFFFFFFFu
+#define TIMER_TAG   0xFFFFFFFEu
+
+// One physical keyboard, with its own word and modifier state
+typedef struct {
+    char path[64];
+    int fd;
+    struct libevdev *dev;
+    UnikeyEngine *engine;
+    bool shift_pressed;
+    bool ctrl_pressed;
+    bool caps_lock;
+    bool grab_pending;                  // Waiting for all keys to be released
+    bool grabbed;                       // Exclusive: we re-inject what the app sees
+    struct libevdev_uinput *clone;      // Grab mode: re-injects this keyboard's events
+    uint8_t consumed[KEY_CNT / 8];      // Pressed keys the engine swallowed
+} KeyboardDevice;
+
+static KeyboardDevice devices[MAX_DEVICES];
+static KeyboardDevice replay_device;
+static int epoll_fd = -1;
+static int inotify_fd = -1;
+static int timer_fd = -1;
+static int word_timeout_ms = 0;
 static volatile sig_atomic_t running = 1;
 static bool vietnamese_mode = true;
-static Word current_word;
+static UnikeyMethod input_method = UNIKEY_TELEX;
+static UnikeyEncoding output_encoding = UNIKEY_UNICODE;
 
-// Modifier state
-static bool shift_pressed = false;
-static bool ctrl_pressed = false;
+static const char *const method_names[UNIKEY_METHOD_COUNT] = { "telex", "vni", "viqr" };
+static const char *const encoding_names[UNIKEY_ENCODING_COUNT] = {
+    "unicode", "nfd", "tcvn3", "vni-win", "viscii",
+};
+static bool grab_mode = false;
+static bool scan_pending = false;       // Started on the cached keyboard alone
 
 static void signal_handler(int sig) {
     (void)sig;
     running = 0;
 }
 
-// Find keyboard device
-static char* find_keyboard(void) {
-    char path[64];
-    int best_score = 0;
-    char best_path[64] = {0};
+// ============================================================================
+// DEVICE MANAGEMENT
+// ============================================================================
 
-    for (int i = 0; i < 20; i++) {
-        snprintf(path, sizeof(path), "/dev/input/event%d", i);
-        int test_fd = open(path, O_RDONLY | O_NONBLOCK);
-        if (test_fd < 0) continue;
+static KeyboardDevice *find_device(const char *path) {
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i].fd >= 0 && strcmp(devices[i].path, path) == 0) return &devices[i];
+    }
+    return NULL;
+}
 
-        struct libevdev *test_dev = NULL;
-        if (libevdev_new_from_fd(test_fd, &test_dev) < 0) {
-            close(test_fd);
-            continue;
-        }
+// Keys held right now, from the kernel (libevdev's copy goes stale while
+// the event mask hides keys); false if it cannot tell
+static bool read_key_state(const KeyboardDevice *kd, uint8_t keys[KEY_CNT / 8]) {
+    memset(keys, 0, KEY_CNT / 8);
+    return ioctl(kd->fd, EVIOCGKEY(KEY_CNT / 8), keys) >= 0;
+}
 
-        const char *name = libevdev_get_name(test_dev);
-        bool skip = name && (strstr(name, "Mouse") || strstr(name, "mouse") ||
-                            strstr(name, "Virtual") || strstr(name, "UniKey"));
-
-        if (!skip) {
-            int score = 0;
-            for (int k = KEY_Q; k <= KEY_P; k++)
-                if (libevdev_has_event_code(test_dev, EV_KEY, k)) score++;
-            for (int k = KEY_A; k <= KEY_L; k++)
-                if (libevdev_has_event_code(test_dev, EV_KEY, k)) score++;
-            for (int k = KEY_Z; k <= KEY_M; k++)
-                if (libevdev_has_event_code(test_dev, EV_KEY, k)) score++;
-            if (libevdev_has_event_code(test_dev, EV_KEY, KEY_ENTER)) score += 5;
-            if (libevdev_has_event_code(test_dev, EV_KEY, KEY_SPACE)) score += 5;
-
-            if (score > best_score) {
-                best_score = score;
-                snprintf(best_path, sizeof(best_path), "%s", path);
-            }
-        }
-        libevdev_free(test_dev);
-        close(test_fd);
+static inline bool key_bit(const uint8_t *keys, int code) {
+    return keys[code >> 3] & (1u << (code & 7));
+}
+
+// CapsLock as the compositor last set the keyboard LED
+static void read_caps_lock(KeyboardDevice *kd) {
+    uint8_t leds[(LED_CNT + 7) / 8] = {0};
+    if (ioctl(kd->fd, EVIOCGLED(sizeof(leds)), leds) >= 0) kd->caps_lock = key_bit(leds, LED_CAPSL);
+}
+
+static bool any_key_held(const KeyboardDevice *kd) {
+    uint8_t keys[KEY_CNT / 8];
+    if (!read_key_state(kd, keys)) return true;
+    for (int i = 0; i < KEY_CNT / 8; i++) {
+        if (keys[i]) return true;
     }
+    return false;
+}
 
-    return (best_score >= 20) ? strdup(best_path) : NULL;
+// Grab mode: a uinput device with the keyboard's own capabilities (every
+// key, LED, EV_MSC, ...), named "UniKey: ..." so device scans skip it
+static bool create_clone(KeyboardDevice *kd) {
+    char real[256], name[sizeof(real) + 8];
+    snprintf(real, sizeof(real), "%s", libevdev_get_name(kd->dev));
+    snprintf(name, sizeof(name), "UniKey: %s", real);
+    libevdev_set_name(kd->dev, name);
+    int rc = libevdev_uinput_create_from_device(kd->dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &kd->clone);
+    libevdev_set_name(kd->dev, real);
+    if (rc < 0) {
+        fprintf(stderr, "Cannot create a uinput copy of %s (%s), using backspace mode\n",
+                kd->path, strerror(-rc));
+        kd->clone = NULL;
+        return false;
+    }
+    return true;
 }
 
-// Send backspaces + text via wtype (single call for efficiency)
-static void wtype_replace(int bs_count, const char *text) {
-    char *args[128];
-    int idx = 0;
-    args[idx++] = "wtype";
+static void destroy_clone(KeyboardDevice *kd) {
+    if (!kd->clone) return;
+    output_forward_close(libevdev_uinput_get_fd(kd->clone));
+    libevdev_uinput_destroy(kd->clone);
+    kd->clone = NULL;
+}
 
-    for (int i = 0; i < bs_count && idx < 100; i++) {
-        args[idx++] = "-k";
-        args[idx++] = "BackSpace";
+// Grab once no key is held, so no press reaches the app without its release
+static void try_grab(KeyboardDevice *kd) {
+    if (!kd->clone) {
+        kd->grab_pending = false;
+        return;
     }
+    if (any_key_held(kd)) return;
+    if (libevdev_grab(kd->dev, LIBEVDEV_GRAB) < 0) {
+        fprintf(stderr, "Cannot grab %s, using backspace mode\n", kd->path);
+        kd->grab_pending = false;
+        return;
+    }
+    kd->grab_pending = false;
+    kd->grabbed = true;
+    memset(kd->consumed, 0, sizeof(kd->consumed));
+}
 
-    if (text && *text) {
-        args[idx++] = "--";
-        args[idx++] = (char*)text;
+// English mode: the kernel only passes Ctrl and Space to us, so typing
+// wakes nothing up. EV_SYN cannot be masked, but empty frames are dropped
+static bool set_english_mask(KeyboardDevice *kd, bool english) {
+    uint8_t codes[KEY_CNT / 8];
+    memset(codes, english ? 0 : 0xFF, sizeof(codes));
+    if (english) {
+        codes[KEY_LEFTCTRL >> 3] |= 1u << (KEY_LEFTCTRL & 7);
+        codes[KEY_RIGHTCTRL >> 3] |= 1u << (KEY_RIGHTCTRL & 7);
+        codes[KEY_SPACE >> 3] |= 1u << (KEY_SPACE & 7);
     }
-    args[idx] = NULL;
+    for (unsigned type = EV_KEY; type < EV_CNT; type++) {
+        if (!libevdev_has_event_type(kd->dev, type)) continue;
+        struct input_mask mask = {
+            .type = type,
+            .codes_size = (english && type != EV_KEY) ? 0 : sizeof(codes),    // 0: none
+            .codes_ptr = (uint64_t)(uintptr_t)codes,
+        };
+        if (ioctl(kd->fd, EVIOCSMASK, &mask) < 0) return false;    // Kernel < 4.4
+    }
+    return true;
+}
 
-    pid_t pid = fork();
-    if (pid == 0) {
-        int devnull = open("/dev/null", O_WRONLY);
-        if (devnull >= 0) { dup2(devnull, STDERR_FILENO); close(devnull); }
-        execvp("wtype", args);
-        _exit(1);
-    } else if (pid > 0) {
-        waitpid(pid, NULL, 0);
+// Release the grab once no key is held, so every release reaches the app
+// the same way as its press, then let the mask filter the keyboard
+static void try_ungrab(KeyboardDevice *kd) {
+    if (any_key_held(kd)) return;
+    libevdev_grab(kd->dev, LIBEVDEV_UNGRAB);
+    kd->grabbed = false;
+    set_english_mask(kd, true);
+}
+
+// Switch one keyboard to the current mode. Back in Vietnamese mode the
+// modifiers are read from the kernel: their events were filtered out
+static void apply_mode(KeyboardDevice *kd) {
+    if (!vietnamese_mode) {
+        kd->grab_pending = false;
+        if (!kd->grabbed) set_english_mask(kd, true);
+        return;
+    }
+    set_english_mask(kd, false);
+    uint8_t keys[KEY_CNT / 8];
+    if (read_key_state(kd, keys)) {
+        kd->shift_pressed = key_bit(keys, KEY_LEFTSHIFT) || key_bit(keys, KEY_RIGHTSHIFT);
+        kd->ctrl_pressed = key_bit(keys, KEY_LEFTCTRL) || key_bit(keys, KEY_RIGHTCTRL);
+    }
+    read_caps_lock(kd);
+    if (kd->clone && !kd->grabbed) {
+        kd->grab_pending = true;
+        try_grab(kd);
     }
 }
 
-// Key to character
-static char key_to_char(int code, bool shift) {
-    static const char map[64] = {
-        [KEY_A] = 'a', [KEY_B] = 'b', [KEY_C] = 'c', [KEY_D] = 'd',
-        [KEY_E] = 'e', [KEY_F] = 'f', [KEY_G] = 'g', [KEY_H] = 'h',
-        [KEY_I] = 'i', [KEY_J] = 'j', [KEY_K] = 'k', [KEY_L] = 'l',
-        [KEY_M] = 'm', [KEY_N] = 'n', [KEY_O] = 'o', [KEY_P] = 'p',
-        [KEY_Q] = 'q', [KEY_R] = 'r', [KEY_S] = 's', [KEY_T] = 't',
-        [KEY_U] = 'u', [KEY_V] = 'v', [KEY_W] = 'w', [KEY_X] = 'x',
-        [KEY_Y] = 'y', [KEY_Z] = 'z',
+// Open a keyboard and add it to the epoll set
+static bool add_device(const char *path) {
+    if (find_device(path)) return false;
+
+    int slot = -1;
+    for (int i = 0; i < MAX_DEVICES && slot < 0; i++) {
+        if (devices[i].fd < 0) slot = i;
+    }
+    if (slot < 0) return false;
+
+    int dfd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (dfd < 0) return false;
+
+    struct libevdev *d = NULL;
+    if (libevdev_new_from_fd(dfd, &d) < 0) {
+        close(dfd);
+        return false;
+    }
+
+    // Event timestamps on the same clock as stats_now()
+    libevdev_set_clock_id(d, CLOCK_MONOTONIC);
+
+    UnikeyEngine *engine = unikey_new();
+    struct epoll_event ee = { .events = EPOLLIN, .data.u32 = (uint32_t)slot };
+    if (!engine || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dfd, &ee) < 0) {
+        unikey_free(engine);
+        libevdev_free(d);
+        close(dfd);
+        return false;
+    }
+    unikey_set_vietnamese(engine, vietnamese_mode);
+    unikey_set_method(engine, input_method);
+    unikey_set_encoding(engine, output_encoding);
+    unikey_set_observer(engine, flight_observe, NULL);
+
+    KeyboardDevice *kd = &devices[slot];
+    memset(kd, 0, sizeof(*kd));
+    snprintf(kd->path, sizeof(kd->path), "%s", path);
+    kd->fd = dfd;
+    kd->dev = d;
+    kd->engine = engine;
+    read_caps_lock(kd);
+    if (grab_mode) create_clone(kd);
+    kd->grab_pending = kd->clone && vietnamese_mode;
+    if (kd->grab_pending) try_grab(kd);
+    if (!vietnamese_mode) set_english_mask(kd, true);
+
+    printf("Keyboard: %s (%s)\n", path, libevdev_get_name(d));
+    return true;
+}
+
+static void remove_device(KeyboardDevice *kd) {
+    printf("Keyboard removed: %s\n", kd->path);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, kd->fd, NULL);
+    destroy_clone(kd);
+    libevdev_free(kd->dev);
+    unikey_free(kd->engine);
+    close(kd->fd);
+    kd->dev = NULL;
+    kd->engine = NULL;
+    kd->fd = -1;
+    kd->path[0] = '\0';
+}
+
+// Add every keyboard sysfs reports (no device is opened just to probe it)
+static int scan_devices(void) {
+    int added = 0;
+    char paths[MAX_DEVICES][DEVICE_PATH_MAX];
+    int n = device_scan(paths, MAX_DEVICES);
+    for (int i = 0; i < n; i++) {
+        if (add_device(paths[i])) added++;
+    }
+    return added;
+}
+
+// Hotplug: event nodes appear (IN_CREATE), get their permissions from udev
+// (IN_ATTRIB) and disappear (IN_DELETE)
+static void handle_hotplug(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len = read(inotify_fd, buf, sizeof(buf));
+        if (len <= 0) break;
+
+        for (char *p = buf; p < buf + len;) {
+            struct inotify_event *ie = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ie->len;
+            if (ie->len == 0 || strncmp(ie->name, "event", 5) != 0) continue;
+
+            char path[64];
+            snprintf(path, sizeof(path), INPUT_DIR "/%.32s", ie->name);
+            if (ie->mask & IN_DELETE) {
+                KeyboardDevice *kd = find_device(path);
+                if (kd) remove_device(kd);
+            } else if (device_is_keyboard(ie->name)) {
+                add_device(path);
+            }
+        }
+    }
+}
+
+static void dispatch_event(KeyboardDevice *kd, const struct input_event *ev);
+static void dispatch_traced(KeyboardDevice *kd, int slot, const struct input_event *ev,
+                            uint64_t event_ns);
+
+// One-shot word timeout, re-armed after every burst of input: nothing
+// fires while the keyboard is idle
+static void arm_word_timer(void) {
+    if (timer_fd < 0) return;
+    struct itimerspec its = {
+        .it_value.tv_sec = word_timeout_ms / 1000,
+        .it_value.tv_nsec = (long)(word_timeout_ms % 1000) * 1000000,
     };
-    if (code < 0 || code >= 64) return 0;
-    char c = map[code];
-    return (c && shift) ? (c - 32) : c;
+    timerfd_settime(timer_fd, 0, &its, NULL);
 }
 
-// Telex keys that can trigger transformation
-static inline bool is_telex_key(int code) {
-    return code == KEY_S || code == KEY_F || code == KEY_R ||
-           code == KEY_X || code == KEY_J || code == KEY_Z ||
-           code == KEY_A || code == KEY_E || code == KEY_O ||
-           code == KEY_W || code == KEY_D;
+static void handle_word_timeout(void) {
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0) return;
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i].fd >= 0) unikey_reset(devices[i].engine);
+    }
+    flight_event(-1, FLIGHT_TIMEOUT);
 }
 
-// Keys that break word context
-static inline bool is_word_break(int code) {
-    return code == KEY_SPACE || code == KEY_ENTER || code == KEY_TAB ||
-           code == KEY_ESC || code == KEY_LEFT || code == KEY_RIGHT ||
-           code == KEY_UP || code == KEY_DOWN || code == KEY_HOME ||
-           code == KEY_END || code == KEY_DELETE || code == KEY_PAGEUP ||
-           code == KEY_PAGEDOWN;
+// Drain all pending events of one device
+static void read_device(KeyboardDevice *kd) {
+    struct input_event ev;
+    unsigned int flags = LIBEVDEV_READ_FLAG_NORMAL;
+
+    for (;;) {
+        int rc = libevdev_next_event(kd->dev, flags, &ev);
+        if (rc == -EAGAIN) {
+            if (flags == LIBEVDEV_READ_FLAG_NORMAL) return;
+            flags = LIBEVDEV_READ_FLAG_NORMAL;  // Resync done
+            continue;
+        }
+        if (rc < 0) {
+            remove_device(kd);
+            return;
+        }
+        if (rc == LIBEVDEV_READ_STATUS_SYNC && flags == LIBEVDEV_READ_FLAG_NORMAL) {
+            // Kernel buffer overflowed: events were lost, word state is stale
+            unikey_reset(kd->engine);
+            flight_event((int)(kd - devices), FLIGHT_RESYNC);
+            flags = LIBEVDEV_READ_FLAG_SYNC;
+        }
+
+        replay_record(&ev);
+        dispatch_traced(kd, (int)(kd - devices), &ev,
+                        (uint64_t)ev.input_event_sec * 1000000000ull +
+                        (uint64_t)ev.input_event_usec * 1000);
+    }
+    if (kd->grab_pending) try_grab(kd);
+    else if (kd->grabbed && !vietnamese_mode) try_ungrab(kd);
+    arm_word_timer();
 }
 
-// Punctuation/number keys
-static inline bool is_punct_key(int code) {
-    return (code >= KEY_1 && code <= KEY_0) ||
-           code == KEY_MINUS || code == KEY_EQUAL ||
-           code == KEY_LEFTBRACE || code == KEY_RIGHTBRACE ||
-           code == KEY_SEMICOLON || code == KEY_APOSTROPHE ||
-           code == KEY_GRAVE || code == KEY_BACKSLASH ||
-           code == KEY_COMMA || code == KEY_DOT || code == KEY_SLASH;
+// ============================================================================
+// EVENT HANDLING
+// ============================================================================
+
+// Apply an engine edit, also erasing the raw key the app already got
+// unless the keyboard is grabbed and the key never reached it
+static void emit_edit(const KeyboardDevice *kd, const UnikeyEdit *edit) {
+    int backspaces = edit->backspaces + (kd->grabbed ? 0 : 1);
+    flight_edit(backspaces, edit->text);
+    output_replace(backspaces, edit->text);
 }
 
 int keyboard_init(void) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    telex_init();
-    telex_reset(&current_word);
+    for (int i = 0; i < MAX_DEVICES; i++) devices[i].fd = -1;
 
-    char *devpath = find_keyboard();
-    if (!devpath) {
-        fprintf(stderr, "No keyboard found\n");
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        fprintf(stderr, "epoll_create1: %s\n", strerror(errno));
         return -1;
     }
 
-    fd = open(devpath, O_RDONLY);
-    if (fd < 0) {
-        fprintf(stderr, "Cannot open %s: %s\n", devpath, strerror(errno));
-        free(devpath);
-        return -1;
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0 &&
+        inotify_add_watch(inotify_fd, INPUT_DIR, IN_CREATE | IN_ATTRIB | IN_DELETE) >= 0) {
+        struct epoll_event ee = { .events = EPOLLIN, .data.u32 = INOTIFY_TAG };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &ee);
+    } else {
+        fprintf(stderr, "Hotplug disabled: %s\n", strerror(errno));
+        if (inotify_fd >= 0) close(inotify_fd);
+        inotify_fd = -1;
     }
-    printf("Keyboard: %s\n", devpath);
-    free(devpath);
 
-    if (libevdev_new_from_fd(fd, &dev) < 0) {
-        close(fd);
-        return -1;
+    if (word_timeout_ms > 0) {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct epoll_event ee = { .events = EPOLLIN, .data.u32 = TIMER_TAG };
+        if (timer_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ee) < 0) {
+            fprintf(stderr, "Word timeout disabled: %s\n", strerror(errno));
+            if (timer_fd >= 0) close(timer_fd);
+            timer_fd = -1;
+        }
+    }
+
+    // The keyboard remembered from the last run is enough to start: the
+    // other keyboards are scanned once the loop first finds nothing to do
+    char cached[DEVICE_PATH_MAX];
+    if (device_cache_load(cached, sizeof(cached)) && add_device(cached)) {
+        scan_pending = true;
+    } else if (scan_devices() == 0) {
+        if (inotify_fd < 0) {
+            fprintf(stderr, "No keyboard found\n");
+            keyboard_cleanup();
+            return -1;
+        }
+        fprintf(stderr, "No keyboard found, waiting for one to be plugged in\n");
+    } else {
+        for (int i = 0; i < MAX_DEVICES; i++) {
+            if (devices[i].fd >= 0) {
+                device_cache_save(devices[i].path);
+                break;
+            }
+        }
     }
 
-    printf("UniKey ready. Mode: %s | Toggle: Ctrl+Space\n",
-           vietnamese_mode ? "VI" : "EN");
+    printf("UniKey ready. Mode: %s | Method: %s | Toggle: Ctrl+Space\n",
+           vietnamese_mode ? "VI" : "EN", method_names[input_method]);
     return 0;
 }
 
 void keyboard_cleanup(void) {
-    if (dev) libevdev_free(dev);
-    if (fd >= 0) close(fd);
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        destroy_clone(&devices[i]);
+        if (devices[i].dev) libevdev_free(devices[i].dev);
+        if (devices[i].fd >= 0) close(devices[i].fd);
+        unikey_free(devices[i].engine);
+        devices[i].dev = NULL;
+        devices[i].engine = NULL;
+        devices[i].fd = -1;
+    }
+    unikey_free(replay_device.engine);
+    replay_device.engine = NULL;
+    if (timer_fd >= 0) close(timer_fd);
+    if (inotify_fd >= 0) close(inotify_fd);
+    if (epoll_fd >= 0) close(epoll_fd);
+    timer_fd = inotify_fd = epoll_fd = -1;
 }
 
 void keyboard_toggle_vietnamese(void) {
     vietnamese_mode = !vietnamese_mode;
-    telex_reset(&current_word);
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (!devices[i].engine) continue;
+        unikey_set_vietnamese(devices[i].engine, vietnamese_mode);
+        apply_mode(&devices[i]);
+    }
+    if (replay_device.engine) unikey_set_vietnamese(replay_device.engine, vietnamese_mode);
+    // Whatever was typed meanwhile is unknown to the output models
+    output_typed(0);
     printf("\rMode: %s      \n", vietnamese_mode ? "VI" : "EN");
 }
 
@@ -190,109 +461,236 @@ bool keyboard_is_vietnamese(void) {
     return vietnamese_mode;
 }
 
-void keyboard_run(void) {
-    struct input_event ev;
+int keyboard_set_method(const char *name) {
+    for (int m = 0; m < UNIKEY_METHOD_COUNT; m++) {
+        if (strcmp(name, method_names[m]) == 0) {
+            input_method = (UnikeyMethod)m;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unknown input method: %s (telex, vni, viqr)\n", name);
+    return -1;
+}
 
-    while (running) {
-        int rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL | LIBEVDEV_READ_FLAG_BLOCKING, &ev);
-        if (rc < 0) {
-            if (rc == -EAGAIN) { usleep(1000); continue; }
-            break;
+int keyboard_set_encoding(const char *name) {
+    for (int e = 0; e < UNIKEY_ENCODING_COUNT; e++) {
+        if (strcmp(name, encoding_names[e]) == 0) {
+            output_encoding = (UnikeyEncoding)e;
+            return 0;
         }
+    }
+    fprintf(stderr, "Unknown encoding: %s (unicode, nfd, tcvn3, vni-win, viscii)\n", name);
+    return -1;
+}
 
-        if (ev.type != EV_KEY) continue;
+void keyboard_next_method(void) {
+    input_method = (UnikeyMethod)((input_method + 1) % UNIKEY_METHOD_COUNT);
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i].engine) unikey_set_method(devices[i].engine, input_method);
+    }
+    if (replay_device.engine) unikey_set_method(replay_device.engine, input_method);
+    printf("\rMethod: %s      \n", method_names[input_method]);
+}
 
-        // Track modifiers
-        if (ev.code == KEY_LEFTSHIFT || ev.code == KEY_RIGHTSHIFT) {
-            shift_pressed = (ev.value != 0);
-            continue;
-        }
-        if (ev.code == KEY_LEFTCTRL || ev.code == KEY_RIGHTCTRL) {
-            ctrl_pressed = (ev.value != 0);
-            continue;
-        }
+void keyboard_set_word_timeout(int ms) {
+    word_timeout_ms = ms > 0 ? ms : 0;
+}
 
-        // Only key press (not release or repeat)
-        if (ev.value != 1) continue;
+void keyboard_set_grab(bool grab) {
+    grab_mode = grab;
+}
 
-        // Ctrl+Space toggle
-        if (ev.code == KEY_SPACE && ctrl_pressed) {
-            keyboard_toggle_vietnamese();
-            continue;
-        }
-        // Skip if Ctrl held (shortcuts)
-        if (ctrl_pressed) {
-            telex_reset(&current_word);
-            continue;
-        }
+bool keyboard_is_grabbing(void) {
+    return grab_mode;
+}
 
-        // English mode - just track buffer for sync
-        if (!vietnamese_mode) {
-            char c = key_to_char(ev.code, shift_pressed);
-            if (c && current_word.len < MAX_WORD_LEN - 1) {
-                current_word.chars[current_word.len++] = c;
-            } else if (is_word_break(ev.code) || is_punct_key(ev.code)) {
-                telex_reset(&current_word);
-            } else if (ev.code == KEY_BACKSPACE && current_word.len > 0) {
-                current_word.len--;
-            }
-            continue;
-        }
+// Returns true when a key press was turned into an edit and must not reach
+// the app as-is (only matters for grabbed keyboards)
+static bool handle_event(KeyboardDevice *kd, const struct input_event *ev) {
+    if (ev->type != EV_KEY) return false;
+    const KeyInfo *key = keymap_key(ev->code);
 
-        // Vietnamese mode
+    // Track modifiers
+    if (key->flags & KEYMAP_SHIFT) {
+        kd->shift_pressed = (ev->value != 0);
+        return false;
+    }
+    if (key->flags & KEYMAP_CTRL) {
+        kd->ctrl_pressed = (ev->value != 0);
+        return false;
+    }
 
-        // Backspace
-        if (ev.code == KEY_BACKSPACE) {
-            if (current_word.len > 0) current_word.len--;
-            if (current_word.len == 0) telex_reset(&current_word);
-            continue;
-        }
+    // Only key press (not release or repeat)
+    if (ev->value != 1) return false;
 
-        // Word break
-        if (is_word_break(ev.code) || is_punct_key(ev.code)) {
-            telex_reset(&current_word);
-            continue;
-        }
+    if (key->flags & KEYMAP_CAPSLOCK) {
+        kd->caps_lock = !kd->caps_lock;
+        return false;
+    }
 
-        // Get character
-        char c = key_to_char(ev.code, shift_pressed);
-        if (!c) {
-            telex_reset(&current_word);
-            continue;
+    // Ctrl+Space toggle, Ctrl+Shift+Space next input method (English mode
+    // masks Shift, so it only toggles there)
+    if (ev->code == KEY_SPACE && kd->ctrl_pressed) {
+        flight_action(FLIGHT_TOGGLE);
+        if (vietnamese_mode && kd->shift_pressed) keyboard_next_method();
+        else keyboard_toggle_vietnamese();
+        return true;
+    }
+    // English mode: nothing else to look at
+    if (!vietnamese_mode) return false;
+
+    // Skip if Ctrl held (shortcuts)
+    if (kd->ctrl_pressed) {
+        flight_action(FLIGHT_RESET);
+        unikey_reset(kd->engine);
+        return false;
+    }
+
+    if (key->flags & KEYMAP_BACKSPACE) {
+        flight_action(FLIGHT_BACKSPACE);
+        unikey_backspace(kd->engine);
+        return false;
+    }
+
+    // Word break, or a key that is neither a letter nor a method key (VNI
+    // digits, VIQR punctuation)
+    char c = keymap_char(key, kd->shift_pressed, kd->caps_lock);
+    if (!(key->flags & KEYMAP_LETTER) && !unikey_is_method_key(kd->engine, c)) {
+        flight_action(FLIGHT_RESET);
+        unikey_reset(kd->engine);
+        return false;
+    }
+
+    UnikeyEdit edit;
+    bool changed = unikey_key(kd->engine, c, &edit);
+    stats_mark(STAT_ENGINE);
+    if (changed) {
+        emit_edit(kd, &edit);
+        return true;
+    }
+    return false;
+}
+
+// Without a grab the app gets every key before our edit; tell the output
+// models (coalescing window, input method) what it typed
+static void note_typed(const KeyboardDevice *kd, const struct input_event *ev) {
+    if (ev->type != EV_KEY || ev->value == 0) return;
+    const KeyInfo *key = keymap_key(ev->code);
+    if (key->flags & KEYMAP_MODIFIER) return;
+    if ((key->flags & KEYMAP_BACKSPACE) && !kd->ctrl_pressed) {
+        output_typed('\b');
+        return;
+    }
+    char c = kd->ctrl_pressed ? 0 : keymap_char(key, kd->shift_pressed, kd->caps_lock);
+    output_typed((uint32_t)(unsigned char)c);
+}
+
+// Run one event through the engine; a grabbed keyboard re-injects every
+// event the engine left alone (any type), including the releases of those
+// keys, through its uinput copy
+static void dispatch_event(KeyboardDevice *kd, const struct input_event *ev) {
+    if (!kd->grabbed && vietnamese_mode) note_typed(kd, ev);
+    bool consumed = handle_event(kd, ev);
+    if (!kd->grabbed) return;
+
+    if (ev->type == EV_KEY && ev->code < KEY_CNT) {
+        uint8_t bit = 1u << (ev->code & 7);
+        uint8_t *slot = &kd->consumed[ev->code >> 3];
+        if (ev->value == 1) {
+            *slot = consumed ? (*slot | bit) : (*slot & ~bit);
+        } else if (*slot & bit) {
+            if (ev->value == 0) *slot &= ~bit;
+            consumed = true;
         }
+    }
+    if (!consumed) {
+        output_forward(kd->clone ? libevdev_uinput_get_fd(kd->clone) : -1,
+                       ev->type, ev->code, ev->value);
+    }
+}
 
-        // Try telex transformation
-        if (is_telex_key(ev.code) && current_word.len > 0) {
-            int old_len = current_word.len;
-            Word backup = current_word;
-
-            int result = telex_process(&current_word, c);
-
-            if (result == 1) {
-                // Transformation succeeded
-                // Delete old text + the key just typed, then type new text
-                char utf8[MAX_WORD_LEN * 4 + 1];
-                word_to_utf8(&current_word, utf8, sizeof(utf8));
-                wtype_replace(old_len + 1, utf8);
-                continue;
-            } else if (result == 2) {
-                // Double press - undo and add the char
-                if (current_word.len < MAX_WORD_LEN - 1) {
-                    current_word.chars[current_word.len++] = c;
-                }
-                char utf8[MAX_WORD_LEN * 4 + 1];
-                word_to_utf8(&current_word, utf8, sizeof(utf8));
-                wtype_replace(old_len + 1, utf8);
-                continue;
-            }
+// Key presses are traced: latency stages and a flight recorder entry
+static void dispatch_traced(KeyboardDevice *kd, int slot, const struct input_event *ev,
+                            uint64_t event_ns) {
+    if (ev->type != EV_KEY || ev->value != 1) {
+        dispatch_event(kd, ev);
+        return;
+    }
+    unsigned mods = (kd->shift_pressed ? FLIGHT_SHIFT : 0) | (kd->ctrl_pressed ? FLIGHT_CTRL : 0) |
+                    (kd->grabbed ? FLIGHT_GRABBED : 0) | (vietnamese_mode ? FLIGHT_VI : 0);
+    stats_begin(event_ns);
+    flight_begin(slot, ev->code, mods, event_ns);
+    dispatch_event(kd, ev);
+    flight_end();
+    stats_end();
+}
+
+void keyboard_handle_event(const struct input_event *ev) {
+    // Replay has no timerfd: apply the word timeout to the recorded gaps
+    static long long last_us = -1;
+    long long us = (long long)ev->input_event_sec * 1000000 + ev->input_event_usec;
+    if (!replay_device.engine) {
+        replay_device.engine = unikey_new();
+        if (!replay_device.engine) return;
+        unikey_set_vietnamese(replay_device.engine, vietnamese_mode);
+        unikey_set_method(replay_device.engine, input_method);
+        unikey_set_encoding(replay_device.engine, output_encoding);
+        unikey_set_observer(replay_device.engine, flight_observe, NULL);
+    }
+    if (word_timeout_ms > 0 && last_us >= 0 && us - last_us > word_timeout_ms * 1000LL) {
+        unikey_reset(replay_device.engine);
+    }
+    last_us = us;
 
-            // No transformation, restore
-            current_word = backup;
+    replay_device.grabbed = grab_mode;
+    // Recorded timestamps are wall clock: stages only, no end-to-end
+    dispatch_traced(&replay_device, -1, ev, 0);
+}
+
+void keyboard_run(void) {
+    struct epoll_event events[MAX_DEVICES + 1];
+
+    // The signals the loop checks for are only let in while it waits: one
+    // arriving after the checks stays pending and interrupts epoll_pwait
+    // right away instead of waiting for the next input event
+    sigset_t block, saved, wait_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGUSR1);
+    sigaddset(&block, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &block, &saved);
+    wait_mask = saved;
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+    sigdelset(&wait_mask, SIGUSR1);
+    sigdelset(&wait_mask, SIGUSR2);
+
+    while (running) {
+        stats_poll();
+        flight_poll();
+        int n = epoll_pwait(epoll_fd, events, MAX_DEVICES + 1, scan_pending ? 0 : -1,
+                            &wait_mask);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "epoll_pwait: %s\n", strerror(errno));
+            break;
+        }
+        if (n == 0 && scan_pending) {
+            scan_pending = false;
+            scan_devices();
         }
 
-        // Just add to buffer (original keystroke goes through naturally)
-        if (current_word.len < MAX_WORD_LEN - 1) {
-            current_word.chars[current_word.len++] = c;
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+            if (tag == INOTIFY_TAG) {
+                handle_hotplug();
+            } else if (tag == TIMER_TAG) {
+                handle_word_timeout();
+            } else if (devices[tag].fd >= 0) {
+                read_device(&devices[tag]);
+            }
         }
     }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
 }
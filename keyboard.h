@@ -3,19 +3,47 @@
 
 #include <stdbool.h>
 
-// Initialize keyboard capture (requires root or input group)
+// Initialize keyboard capture on every keyboard, with hotplug
+// (requires root or input group)
 int keyboard_init(void);
 
+// Grab keyboards exclusively and re-inject through the output backend, so
+// a tone key becomes one edit instead of type-then-erase (before init)
+void keyboard_set_grab(bool grab);
+
+// Reset the word after ms of no typing, 0 = never (before init)
+void keyboard_set_word_timeout(int ms);
+
+// Check if grab mode is enabled
+bool keyboard_is_grabbing(void);
+
 // Cleanup
 void keyboard_cleanup(void);
 
 // Start main loop
 void keyboard_run(void);
 
+struct input_event;
+
+// Process one evdev event from a non-device source (replay)
+void keyboard_handle_event(const struct input_event *ev);
+
 // Toggle Vietnamese mode
 void keyboard_toggle_vietnamese(void);
 
 // Check if Vietnamese mode is active
 bool keyboard_is_vietnamese(void);
 
+// Input method by name: "telex" (default), "vni", "viqr". Returns -1
+// (message printed) for an unknown name (before init)
+int keyboard_set_method(const char *name);
+
+// Encoding of the typed text by name: "unicode" (NFC, default), "nfd",
+// "tcvn3", "vni-win", "viscii". Returns -1 (message printed) for an
+// unknown name (before init)
+int keyboard_set_encoding(const char *name);
+
+// Switch to the next input method (Ctrl+Shift+Space)
+void keyboard_next_method(void);
+
 #endif
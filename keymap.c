@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include "keymap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/input.h>
+
+KeyInfo keymap_keys[KEYMAP_CODES];
+
+// ASCII -> keycode, inverse of the table
+static struct {
+    uint8_t code;
+    bool shift;
+} ascii_keys[128];
+
+// A layout is its four main rows, unshifted then shifted; ' ' marks a key
+// typing nothing ASCII (dead key, accented letter)
+#define N_ROWS 4
+
+static const struct {
+    int first;          // Keycode of the first key
+    int len;
+} rows[N_ROWS] = {
+    { KEY_1, 12 },          // 1 .. =
+    { KEY_Q, 12 },          // Q .. ]
+    { KEY_A, 12 },          // A .. ' `
+    { KEY_BACKSLASH, 11 },  // \ Z .. /
+};
+
+typedef struct {
+    const char *name;
+    const char *keys[N_ROWS][2];
+} Layout;
+
+static const Layout layouts[] = {
+    { "qwerty", {
+        { "1234567890-=", "!@#$%^&*()_+" },
+        { "qwertyuiop[]", "QWERTYUIOP{}" },
+        { "asdfghjkl;'`", "ASDFGHJKL:\"~" },
+        { "\\zxcvbnm,./", "|ZXCVBNM<>?" },
+    } },
+    { "dvorak", {
+        { "1234567890[]", "!@#$%^&*(){}" },
+        { "',.pyfgcrl/=", "\"<>PYFGCRL?+" },
+        { "aoeuidhtns-`", "AOEUIDHTNS_~" },
+        { "\\;qjkxbmwvz", "|:QJKXBMWVZ" },
+    } },
+    { "colemak", {
+        { "1234567890-=", "!@#$%^&*()_+" },
+        { "qwfpgjluy;[]", "QWFPGJLUY:{}" },
+        { "arstdhneio'`", "ARSTDHNEIO\"~" },
+        { "\\zxcvbkm,./", "|ZXCVBKM<>?" },
+    } },
+    { "azerty", {
+        { "& \"'(- _  )=", "1234567890 +" },
+        { "azertyuiop $", "AZERTYUIOP  " },
+        { "qsdfghjklm  ", "QSDFGHJKLM% " },
+        { "*wxcvbn,;:!", " WXCVBN?./ " },
+    } },
+};
+
+static void set_key(int code, char c, char shifted) {
+    KeyInfo *k = &keymap_keys[code];
+    k->ch[0] = c == ' ' ? 0 : c;
+    k->ch[1] = shifted == ' ' ? 0 : shifted;
+    k->flags &= (uint8_t)~KEYMAP_LETTER;
+    if (c >= 'a' && c <= 'z') {
+        k->flags |= KEYMAP_LETTER;
+        if (!k->ch[1]) k->ch[1] = (char)(c - 32);
+    }
+}
+
+static void build_layout(const Layout *layout) {
+    memset(keymap_keys, 0, sizeof(keymap_keys));
+    for (int r = 0; r < N_ROWS; r++) {
+        for (int i = 0; i < rows[r].len; i++) {
+            set_key(rows[r].first + i, layout->keys[r][0][i], layout->keys[r][1][i]);
+        }
+    }
+
+    // Same on every layout
+    keymap_keys[KEY_SPACE] = (KeyInfo){ { ' ', ' ' }, 0 };
+    keymap_keys[KEY_ENTER] = (KeyInfo){ { '\n', '\n' }, 0 };
+    keymap_keys[KEY_TAB] = (KeyInfo){ { '\t', '\t' }, 0 };
+    keymap_keys[KEY_BACKSPACE].flags = KEYMAP_BACKSPACE;
+    keymap_keys[KEY_LEFTSHIFT].flags = KEYMAP_MODIFIER | KEYMAP_SHIFT;
+    keymap_keys[KEY_RIGHTSHIFT].flags = KEYMAP_MODIFIER | KEYMAP_SHIFT;
+    keymap_keys[KEY_LEFTCTRL].flags = KEYMAP_MODIFIER | KEYMAP_CTRL;
+    keymap_keys[KEY_RIGHTCTRL].flags = KEYMAP_MODIFIER | KEYMAP_CTRL;
+    keymap_keys[KEY_CAPSLOCK].flags = KEYMAP_MODIFIER | KEYMAP_CAPSLOCK;
+    keymap_keys[KEY_LEFTALT].flags = KEYMAP_MODIFIER;
+    keymap_keys[KEY_RIGHTALT].flags = KEYMAP_MODIFIER;
+    keymap_keys[KEY_LEFTMETA].flags = KEYMAP_MODIFIER;
+    keymap_keys[KEY_RIGHTMETA].flags = KEYMAP_MODIFIER;
+}
+
+// "<keycode> <char> [<shifted char>]" per line, '#' starts a comment
+static int load_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+
+        int code;
+        char c, shifted = ' ';
+        int n = sscanf(p, "%d %c %c", &code, &c, &shifted);
+        if (n < 2 || code <= 0 || code >= KEYMAP_CODES ||
+            (keymap_keys[code].flags & KEYMAP_MODIFIER) || (c & 0x80) || (shifted & 0x80)) {
+            fprintf(stderr, "%s:%d: expected <keycode> <char> [<shifted char>]\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+        set_key(code, c, shifted);
+    }
+    fclose(f);
+    return 0;
+}
+
+int keymap_load(const char *spec) {
+    build_layout(&layouts[0]);
+    if (spec) {
+        const Layout *layout = NULL;
+        for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+            if (strcmp(spec, layouts[i].name) == 0) layout = &layouts[i];
+        }
+        if (layout) build_layout(layout);
+        else if (load_file(spec) < 0) return -1;
+    }
+
+    // Lowest keycode wins when two keys type the same character
+    memset(ascii_keys, 0, sizeof(ascii_keys));
+    for (int code = KEYMAP_CODES - 1; code > 0; code--) {
+        for (int shift = 1; shift >= 0; shift--) {
+            unsigned char c = (unsigned char)keymap_keys[code].ch[shift];
+            if (c && c < 128) {
+                ascii_keys[c].code = (uint8_t)code;
+                ascii_keys[c].shift = shift;
+            }
+        }
+    }
+    return 0;
+}
+
+int keymap_code(char c, bool *shift) {
+    unsigned char u = (unsigned char)c;
+    if (u >= 128 || !ascii_keys[u].code) return 0;
+    *shift = ascii_keys[u].shift;
+    return ascii_keys[u].code;
+}
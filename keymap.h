@@ -0,0 +1,47 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Keyboard layout: what each evdev keycode types and what it is to the
+// engine, in one table built at startup, so every event costs one lookup.
+// The same layout turns typed characters back into keycodes for uinput
+
+#define KEYMAP_CODES 256
+
+// Key attributes
+#define KEYMAP_LETTER       0x01    // a-z: goes to the engine, CapsLock applies
+#define KEYMAP_MODIFIER     0x02    // Never types anything
+#define KEYMAP_SHIFT        0x04
+#define KEYMAP_CTRL         0x08
+#define KEYMAP_CAPSLOCK     0x10
+#define KEYMAP_BACKSPACE    0x20
+
+typedef struct {
+    char ch[2];         // ASCII typed without and with Shift, 0 if none
+    uint8_t flags;
+} KeyInfo;
+
+extern KeyInfo keymap_keys[KEYMAP_CODES];
+
+// Build the table from a built-in layout ("qwerty", "dvorak", "colemak",
+// "azerty") or a file of "<keycode> <char> [<shifted char>]" lines applied
+// over qwerty. NULL = qwerty. Returns -1 (message printed) on error
+int keymap_load(const char *spec);
+
+// Keycode typing ASCII c, 0 if the layout has none; *shift tells if it
+// needs Shift
+int keymap_code(char c, bool *shift);
+
+static inline const KeyInfo *keymap_key(int code) {
+    return &keymap_keys[(unsigned)code < KEYMAP_CODES ? code : 0];
+}
+
+// Character a key types, 0 if none
+static inline char keymap_char(const KeyInfo *key, bool shift, bool caps_lock) {
+    if (key->flags & KEYMAP_LETTER) shift = shift != caps_lock;
+    return key->ch[shift];
+}
+
+#endif
@@ -1,24 +1,128 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #include "keyboard.h"
+#include "output.h"
+#include "replay.h"
+#include "conv.h"
+#include "stats.h"
+#include "flight.h"
+#include "keymap.h"
 
 static void print_usage(const char *prog) {
     printf("UniKey - Vietnamese Input Method for Linux/Wayland\n");
     printf("Usage: %s [options]\n", prog);
     printf("Options:\n");
+    printf("  -u, --uinput  Output through /dev/uinput (accented letters via Ctrl+Shift+U,\n");
+    printf("                GTK/IBus applications only)\n");
+    printf("  -w, --wtype   Output through wtype (default when installed)\n");
+    printf("  -i, --im      Output as a Wayland input method (zwp_input_method_v2)\n");
+    printf("  -g, --grab    Grab keyboards and re-inject keys (no type-then-erase)\n");
+    printf("  -m, --method NAME  Input method: telex (default), vni, viqr\n");
+    printf("  --encoding NAME  Typed text: unicode (default), nfd, tcvn3, vni-win, viscii\n");
+    printf("  --keymap NAME Keyboard layout: qwerty (default), dvorak, colemak, azerty,\n");
+    printf("                or a file of \"<keycode> <char> [<shifted char>]\" lines\n");
+    printf("  -t, --timeout MS  Reset the word after MS of no typing (default: never)\n");
+    printf("  --coalesce US Merge edits made within US microseconds into one (default: off)\n");
+    printf("  --record FILE Record raw key events to FILE\n");
+    printf("  --replay FILE Replay a recording into an in-memory text field\n");
+    printf("  --convert [FILE...]  Convert Telex text (files or stdin) to UTF-8 on stdout\n");
+    printf("  --stats FILE  Write latency percentiles to FILE on SIGUSR1 and exit\n");
+    printf("                (default: stderr on SIGUSR1)\n");
+    printf("  --flight FILE Flight recorder dump on SIGUSR2 or crash\n");
+    printf("                (default: $XDG_RUNTIME_DIR/unikey-flight.json)\n");
+    printf("  -j, --jobs N  Threads for --convert (0 = all cores, default 1)\n");
     printf("  -h, --help    Show this help\n");
     printf("\n");
     printf("Requires root or membership in 'input' group.\n");
-    printf("Toggle: Ctrl+Space\n");
+    printf("Toggle: Ctrl+Space | Next input method: Ctrl+Shift+Space\n");
 }
 
 int main(int argc, char *argv[]) {
-    if (argc > 1) {
-        if (argv[1][0] == '-' && (argv[1][1] == 'h' || argv[1][1] == '-')) {
-            print_usage(argv[0]);
-            return 0;
+    static const struct option long_opts[] = {
+        {"uinput", no_argument, NULL, 'u'},
+        {"wtype",  no_argument, NULL, 'w'},
+        {"im",     no_argument, NULL, 'i'},
+        {"grab",   no_argument, NULL, 'g'},
+        {"timeout", required_argument, NULL, 't'},
+        {"method", required_argument, NULL, 'm'},
+        {"encoding", required_argument, NULL, 'E'},
+        {"keymap", required_argument, NULL, 'K'},
+        {"coalesce", required_argument, NULL, 'O'},
+        {"record", required_argument, NULL, 'R'},
+        {"replay", required_argument, NULL, 'P'},
+        {"convert", no_argument, NULL, 'C'},
+        {"stats",  required_argument, NULL, 'S'},
+        {"flight", required_argument, NULL, 'F'},
+        {"jobs",   required_argument, NULL, 'j'},
+        {"help",   no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    OutputMode output_mode = OUTPUT_AUTO;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *stats_path = NULL;
+    const char *flight_path = NULL;
+    const char *keymap = NULL;
+    bool convert = false;
+    int jobs = 1;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "uwigt:m:j:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'u': output_mode = OUTPUT_UINPUT; break;
+            case 'w': output_mode = OUTPUT_WTYPE; break;
+            case 'i': output_mode = OUTPUT_IM; break;
+            case 'g': keyboard_set_grab(true); break;
+            case 't': keyboard_set_word_timeout(atoi(optarg)); break;
+            case 'm':
+                if (keyboard_set_method(optarg) < 0) return 1;
+                break;
+            case 'E':
+                if (keyboard_set_encoding(optarg) < 0) return 1;
+                break;
+            case 'K': keymap = optarg; break;
+            case 'O': output_set_coalesce(atoi(optarg)); break;
+            case 'R': record_path = optarg; break;
+            case 'P': replay_path = optarg; break;
+            case 'C': convert = true; break;
+            case 'S': stats_path = optarg; break;
+            case 'F': flight_path = optarg; break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (convert) {
+        if (jobs <= 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        return conv_main(argc - optind, argv + optind, jobs);
+    }
+
+    if (keymap_load(keymap) < 0) return 1;
+    stats_init(stats_path);
+    flight_init(flight_path);
+
+    if (replay_path) {
+        int rc = replay_run(replay_path) < 0 ? 1 : 0;
+        if (stats_path) stats_dump();
+        if (flight_path) flight_dump();
+        return rc;
+    }
+
+    if (keyboard_is_grabbing()) {
+        // Grabbed keys can only be passed on through our own virtual keyboard
+        if (output_mode == OUTPUT_WTYPE || output_mode == OUTPUT_IM) {
+            fprintf(stderr, "--grab needs the uinput backend\n");
+            return 1;
         }
+        output_mode = OUTPUT_UINPUT;
     }
 
     if (geteuid() != 0) {
@@ -31,13 +135,34 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (output_init(output_mode) < 0) {
+        fprintf(stderr, "Failed to initialize output\n");
+        return 1;
+    }
+
     if (keyboard_init() < 0) {
         fprintf(stderr, "Failed to initialize keyboard\n");
+        output_cleanup();
         return 1;
     }
 
+    printf("Output: %s\n", output_backend_name());
+
+    if (record_path) {
+        if (replay_record_open(record_path) < 0) {
+            perror(record_path);
+            keyboard_cleanup();
+            output_cleanup();
+            return 1;
+        }
+        printf("Recording to %s\n", record_path);
+    }
+
     keyboard_run();
+    if (stats_path) stats_dump();
+    replay_record_close();
     keyboard_cleanup();
+    output_cleanup();
 
     printf("UniKey exited.\n");
     return 0;
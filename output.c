@@ -0,0 +1,905 @@
+#define _GNU_SOURCE
+#include "output.h"
+#include "stats.h"
+#include "im.h"
+#include "keymap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/uinput.h>
+
+static OutputMode active = OUTPUT_WTYPE;
+static bool emitter_running = false;   // Output thread started
+static int uinput_fd = -1;
+static OutputStats stats;
+
+// ============================================================================
+// UINPUT BACKEND
+// ============================================================================
+
+// Pending events, flushed with a single write() per edit
+#define MAX_EVENTS 4096
+static struct input_event events[MAX_EVENTS];
+static int n_events = 0;
+
+static void push_event(int type, int code, int value) {
+    if (n_events >= MAX_EVENTS) return;
+    struct input_event *ev = &events[n_events++];
+    memset(ev, 0, sizeof(*ev));
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+}
+
+static inline void push_syn(void) {
+    push_event(EV_SYN, SYN_REPORT, 0);
+}
+
+static void push_tap(int code) {
+    push_event(EV_KEY, code, 1);
+    push_syn();
+    push_event(EV_KEY, code, 0);
+    push_syn();
+}
+
+static void push_unicode(uint32_t cp);
+
+// ASCII through the keymap (the compositor applies the same layout to our
+// virtual keyboard), anything else as a Unicode entry
+static void push_codepoint(uint32_t cp) {
+    bool shift;
+    int code = cp < 128 ? keymap_code((char)cp, &shift) : 0;
+    if (!code) {
+        push_unicode(cp);
+        return;
+    }
+    if (shift) {
+        push_event(EV_KEY, KEY_LEFTSHIFT, 1);
+        push_syn();
+    }
+    push_tap(code);
+    if (shift) {
+        push_event(EV_KEY, KEY_LEFTSHIFT, 0);
+        push_syn();
+    }
+}
+
+// Non-ASCII: Ctrl+Shift+U <hex> Space (GTK/IBus Unicode entry)
+static void push_unicode(uint32_t cp) {
+    bool shift;
+    int u = keymap_code('u', &shift);
+    if (!u) return;
+    push_event(EV_KEY, KEY_LEFTCTRL, 1);
+    push_event(EV_KEY, KEY_LEFTSHIFT, 1);
+    push_syn();
+    push_tap(u);
+    push_event(EV_KEY, KEY_LEFTSHIFT, 0);
+    push_event(EV_KEY, KEY_LEFTCTRL, 0);
+    push_syn();
+
+    static const char hex[] = "0123456789abcdef";
+    int bit = 28;
+    while (bit > 0 && ((cp >> bit) & 0xF) == 0) bit -= 4;
+    for (; bit >= 0; bit -= 4) push_codepoint((uint32_t)hex[(cp >> bit) & 0xF]);
+    push_tap(KEY_SPACE);
+}
+
+// Decode one UTF-8 sequence, returns bytes consumed
+static int utf8_decode(const char *s, uint32_t *cp) {
+    const unsigned char *u = (const unsigned char *)s;
+    if (u[0] < 0x80) { *cp = u[0]; return 1; }
+    if ((u[0] & 0xE0) == 0xC0 && u[1]) {
+        *cp = ((u[0] & 0x1F) << 6) | (u[1] & 0x3F);
+        return 2;
+    }
+    if ((u[0] & 0xF0) == 0xE0 && u[1] && u[2]) {
+        *cp = ((u[0] & 0x0F) << 12) | ((u[1] & 0x3F) << 6) | (u[2] & 0x3F);
+        return 3;
+    }
+    if ((u[0] & 0xF8) == 0xF0 && u[1] && u[2] && u[3]) {
+        *cp = ((u[0] & 0x07) << 18) | ((u[1] & 0x3F) << 12) |
+              ((u[2] & 0x3F) << 6) | (u[3] & 0x3F);
+        return 4;
+    }
+    *cp = 0xFFFD;
+    return 1;
+}
+
+// Encode one BMP codepoint, returns bytes written
+static int utf8_encode(uint32_t cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    out[0] = (char)(0xE0 | (cp >> 12));
+    out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+}
+
+static void write_events(int fd, const struct input_event *evs, int count) {
+    const char *p = (const char *)evs;
+    size_t left = (size_t)count * sizeof(struct input_event);
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "uinput write: %s\n", strerror(errno));
+            break;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+}
+
+static void uinput_flush(void) {
+    write_events(uinput_fd, events, n_events);
+    n_events = 0;
+}
+
+// Grab mode: events are re-injected through a uinput copy of their own
+// keyboard (see keyboard.c), one frame per write()
+#define MAX_FWD_EVENTS 64
+static struct input_event fwd_events[MAX_FWD_EVENTS];
+static int n_fwd = 0;
+static int fwd_fd = -1;                 // Copy the pending frame goes to
+static int fwd_shift[2] = { -1, -1 };   // Copy holding each Shift key down
+
+static void fwd_flush(void) {
+    if (n_fwd > 0 && fwd_fd >= 0) write_events(fwd_fd, fwd_events, n_fwd);
+    n_fwd = 0;
+}
+
+// Lift (0) or press again (1) the forwarded Shift keys around typed text
+static void set_held_shift(int value) {
+    static const int codes[2] = { KEY_LEFTSHIFT, KEY_RIGHTSHIFT };
+    for (int i = 0; i < 2; i++) {
+        if (fwd_shift[i] < 0) continue;
+        struct input_event frame[2];
+        memset(frame, 0, sizeof(frame));
+        frame[0].type = EV_KEY;
+        frame[0].code = codes[i];
+        frame[0].value = value;
+        frame[1].type = EV_SYN;
+        frame[1].code = SYN_REPORT;
+        write_events(fwd_shift[i], frame, 2);
+    }
+}
+
+static void uinput_replace(int bs_count, const char *text) {
+    // Forwarded events still waiting for their SYN_REPORT go out first
+    fwd_flush();
+    set_held_shift(0);
+    for (int i = 0; i < bs_count; i++) push_tap(KEY_BACKSPACE);
+
+    while (text && *text) {
+        uint32_t cp;
+        text += utf8_decode(text, &cp);
+        push_codepoint(cp);
+    }
+    stats_mark(STAT_ENCODE);
+    uinput_flush();
+    set_held_shift(1);
+    stats_mark(STAT_SUBMIT);
+}
+
+static void uinput_forward(int fd, int type, int code, int value) {
+    if (fd < 0) return;
+    if (type == EV_KEY && code == KEY_LEFTSHIFT) fwd_shift[0] = value ? fd : -1;
+    if (type == EV_KEY && code == KEY_RIGHTSHIFT) fwd_shift[1] = value ? fd : -1;
+
+    if (fd != fwd_fd) fwd_flush();
+    fwd_fd = fd;
+    struct input_event *ev = &fwd_events[n_fwd++];
+    memset(ev, 0, sizeof(*ev));
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+    if (type == EV_SYN || n_fwd == MAX_FWD_EVENTS) fwd_flush();
+}
+
+static int uinput_open(void) {
+    int ufd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+    if (ufd < 0) return -1;
+
+    ioctl(ufd, UI_SET_EVBIT, EV_KEY);
+    ioctl(ufd, UI_SET_EVBIT, EV_SYN);
+    for (int k = 1; k < 256; k++) ioctl(ufd, UI_SET_KEYBIT, k);
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = 0x554b;   // "UK"
+    setup.id.product = 0x0001;
+    snprintf(setup.name, sizeof(setup.name), "UniKey Virtual Keyboard");
+
+    if (ioctl(ufd, UI_DEV_SETUP, &setup) < 0 || ioctl(ufd, UI_DEV_CREATE) < 0) {
+        int err = errno;
+        close(ufd);
+        errno = err;
+        return -1;
+    }
+
+    // Give the compositor time to pick up the new device
+    usleep(200000);
+    return ufd;
+}
+
+// ============================================================================
+// WTYPE BACKEND
+// ============================================================================
+
+// wtype is started with posix_spawn (vfork semantics: no page table copy)
+// and, on the output thread, not waited for: its pidfd is polled next to
+// the command ring and the next edit starts only after it exits, so at
+// most one runs and edits stay in order
+#define WTYPE_MAX_KEYS 64       // BackSpaces per wtype call
+
+static pid_t wtype_pid = -1;
+static int wtype_pidfd = -1;
+static StatsTrace wtype_trace;
+
+// Wait for the running wtype, if any
+static void wtype_reap(void) {
+    if (wtype_pid < 0) return;
+    while (waitpid(wtype_pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+    if (wtype_pidfd >= 0) close(wtype_pidfd);
+    wtype_pid = -1;
+    wtype_pidfd = -1;
+
+    // Finish that edit's trace without losing the one in progress
+    StatsTrace current = stats_handoff();
+    stats_resume(&wtype_trace);
+    stats_mark(STAT_COMPLETE);
+    stats_end();
+    stats_resume(&current);
+}
+
+// Is an executable wtype on PATH?
+static bool wtype_available(void) {
+    const char *path = getenv("PATH");
+    if (!path) return false;
+    char buf[4096];
+    while (*path) {
+        size_t len = strcspn(path, ":");
+        if (len > 0 && len + sizeof("/wtype") <= sizeof(buf)) {
+            memcpy(buf, path, len);
+            memcpy(buf + len, "/wtype", sizeof("/wtype"));
+            if (access(buf, X_OK) == 0) return true;
+        }
+        path += len;
+        if (*path == ':') path++;
+    }
+    return false;
+}
+
+static void wtype_spawn(int bs_count, const char *text, bool wait) {
+    char *args[2 * WTYPE_MAX_KEYS + 4];
+    int idx = 0;
+    args[idx++] = "wtype";
+    for (int i = 0; i < bs_count; i++) {
+        args[idx++] = "-k";
+        args[idx++] = "BackSpace";
+    }
+    if (text && *text) {
+        args[idx++] = "--";
+        args[idx++] = (char *)text;
+    }
+    args[idx] = NULL;
+    stats_mark(STAT_ENCODE);
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    // The emitter blocks signals and we handle some: wtype starts with
+    // none blocked and default dispositions, so SIGTERM stops it
+    posix_spawnattr_t attr;
+    sigset_t none, all;
+    sigemptyset(&none);
+    sigfillset(&all);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &all);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int rc = posix_spawnp(&pid, "wtype", &fa, &attr, args, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+    if (rc != 0) {
+        fprintf(stderr, "wtype: %s\n", strerror(rc));
+        return;
+    }
+    stats_mark(STAT_SUBMIT);
+
+    wtype_pid = pid;
+    wtype_pidfd = wait ? -1 : (int)syscall(SYS_pidfd_open, pid, 0);
+    wtype_trace = stats_handoff();
+    if (wtype_pidfd < 0) wtype_reap();      // Inline, or kernel < 5.3
+}
+
+// Backspaces + text, in one wtype call unless there are more than
+// WTYPE_MAX_KEYS backspaces; only the last call is left running
+static void wtype_replace(int bs_count, const char *text) {
+    wtype_reap();
+    bool wait = !emitter_running;
+    while (bs_count > WTYPE_MAX_KEYS) {
+        wtype_spawn(WTYPE_MAX_KEYS, NULL, true);
+        bs_count -= WTYPE_MAX_KEYS;
+    }
+    wtype_spawn(bs_count, text, wait);
+}
+
+// ============================================================================
+// MEMORY BACKEND (replay)
+// ============================================================================
+
+// Emulated text field: raw keys and edits land here instead of an app
+static uint32_t *mem_text = NULL;
+static int mem_len = 0, mem_cap = 0;
+static char *mem_utf8 = NULL;
+static bool mem_shift = false, mem_ctrl = false, mem_caps = false;
+
+static void mem_append(uint32_t cp) {
+    if (mem_len == mem_cap) {
+        int cap = mem_cap ? mem_cap * 2 : 4096;
+        uint32_t *p = realloc(mem_text, sizeof(uint32_t) * cap);
+        if (!p) return;
+        mem_text = p;
+        mem_cap = cap;
+    }
+    mem_text[mem_len++] = cp;
+}
+
+static void mem_backspace(int count) {
+    mem_len = (count < mem_len) ? mem_len - count : 0;
+}
+
+static void memory_open(void) {
+    mem_len = 0;
+    mem_shift = mem_ctrl = mem_caps = false;
+}
+
+static void memory_replace(int bs_count, const char *text) {
+    mem_backspace(bs_count);
+    while (text && *text) {
+        uint32_t cp;
+        text += utf8_decode(text, &cp);
+        mem_append(cp);
+    }
+    stats_mark(STAT_ENCODE);
+}
+
+void output_memory_key(int code, int value) {
+    const KeyInfo *key = keymap_key(code);
+    if (key->flags & KEYMAP_SHIFT) { mem_shift = value != 0; return; }
+    if (key->flags & KEYMAP_CTRL) { mem_ctrl = value != 0; return; }
+    if (value == 0 || mem_ctrl) return;
+
+    if (key->flags & KEYMAP_CAPSLOCK) {
+        if (value == 1) mem_caps = !mem_caps;
+        return;
+    }
+    if (key->flags & KEYMAP_BACKSPACE) {
+        mem_backspace(1);
+        return;
+    }
+    char c = keymap_char(key, mem_shift, mem_caps);
+    if (c) mem_append((uint32_t)c);
+}
+
+const char *output_memory_text(void) {
+    free(mem_utf8);
+    mem_utf8 = malloc((size_t)mem_len * 4 + 1);
+    if (!mem_utf8) return "";
+
+    char *p = mem_utf8;
+    for (int i = 0; i < mem_len; i++) p += utf8_encode(mem_text[i], p);
+    *p = '\0';
+    return mem_utf8;
+}
+
+// ============================================================================
+// EMITTER THREAD
+// ============================================================================
+
+// uinput, wtype and the input method run on their own thread, so a slow
+// edit (wtype waits for a child process) never stops input from being
+// read. Edits and forwarded events go through one single-producer/
+// single-consumer ring and reach the backend strictly in the order they
+// were made.
+
+#define QUEUE_SIZE 256          // Power of two
+#define CMD_TEXT_MAX 96         // Longer edits are split over several commands
+
+typedef enum {
+    CMD_REPLACE,
+    CMD_FORWARD,
+    CMD_TYPED,          // A key reached the app directly (text models)
+    CMD_FLUSH,          // Emit the coalescing window now
+    CMD_STOP
+} CommandKind;
+
+typedef struct {
+    uint8_t kind;
+    uint16_t type, code;        // CMD_FORWARD
+    int32_t fd;                 // CMD_FORWARD: uinput copy of the source keyboard
+    int32_t value;              // CMD_FORWARD, CMD_TYPED: codepoint or '\b'
+    int32_t backspaces;         // CMD_REPLACE
+    StatsTrace trace;           // Latency trace handed over by the reader
+    char text[CMD_TEXT_MAX];
+} Command;
+
+static struct {
+    Command slots[QUEUE_SIZE];
+    _Alignas(64) _Atomic uint32_t head;         // Written by the producer only
+    _Atomic bool consumer_waiting;
+    _Alignas(64) _Atomic uint32_t tail;         // Commands done (consumer only)
+    _Atomic bool producer_waiting;
+} queue;
+
+static pthread_t emitter;
+static uint64_t coalesce_ns = 0;
+static _Atomic long merged_edits = 0;
+static int ready_fd = -1;       // Producer -> consumer: commands queued
+static int space_fd = -1;       // Consumer -> producer: commands done
+
+static void backend_replace(int bs_count, const char *text);
+static void backend_forward(int fd, int type, int code, int value);
+static void backend_typed(uint32_t cp);
+
+static void wake(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+static void sleep_on(int fd) {
+    uint64_t n;
+    while (read(fd, &n, sizeof(n)) < 0 && errno == EINTR) {
+    }
+}
+
+// Wait until at most max_in_flight of the commands before head are left
+// undone. The flag is set before checking again, and the consumer checks
+// it after moving tail, so one of the two always sees the other. Both
+// sides are a store then a load of another variable: only seq_cst keeps
+// the load from being done first (store buffer)
+static void wait_for_tail(uint32_t head, uint32_t max_in_flight) {
+    while (head - atomic_load_explicit(&queue.tail, memory_order_acquire) > max_in_flight) {
+        atomic_store(&queue.producer_waiting, true);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (head - atomic_load(&queue.tail) > max_in_flight) sleep_on(space_fd);
+        atomic_store(&queue.producer_waiting, false);
+    }
+}
+
+// Reader thread side. Blocks only when QUEUE_SIZE commands are pending:
+// the reader then stops reading, and events wait in the kernel buffer
+static void enqueue(const Command *cmd) {
+    uint32_t head = atomic_load_explicit(&queue.head, memory_order_relaxed);
+    wait_for_tail(head, QUEUE_SIZE - 1);
+
+    queue.slots[head & (QUEUE_SIZE - 1)] = *cmd;
+    atomic_store(&queue.head, head + 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&queue.consumer_waiting)) wake(ready_fd);
+}
+
+// ============================================================================
+// COALESCING WINDOW
+// ============================================================================
+
+// With a window, the first edit is held for coalesce_ns and every edit
+// arriving meanwhile is folded into it. Text before the window is unknown;
+// the model only tracks what happened to it since: characters deleted from
+// its end, and the characters typed after. "app" is what the application
+// has (keys it got directly), "want" what it should have (the edits too).
+// The flush sends the difference as one edit.
+#define WINDOW_CHARS 128
+#define WINDOW_TRACES 16
+
+static struct {
+    bool active;
+    uint64_t deadline;
+    int app_cut, want_cut;      // Characters deleted before the window
+    int app_len, want_len;
+    uint32_t app[WINDOW_CHARS];
+    uint32_t want[WINDOW_CHARS];
+    int n_edits;
+    int n_traces;
+    StatsTrace traces[WINDOW_TRACES];
+} win;
+
+static void window_backspace(int *cut, int *len) {
+    if (*len > 0) (*len)--;
+    else (*cut)++;
+}
+
+static void window_flush(void) {
+    if (!win.active) return;
+    win.active = false;
+
+    // Keep the longest common prefix when both start at the same point; a
+    // text the app deleted that the edits kept cannot be retyped, which
+    // would need app_cut > want_cut (edits only ever delete more)
+    int common = 0;
+    if (win.app_cut == win.want_cut) {
+        while (common < win.app_len && common < win.want_len &&
+               win.app[common] == win.want[common]) common++;
+    }
+    int backspaces = win.app_len - common;
+    if (win.want_cut > win.app_cut) backspaces += win.want_cut - win.app_cut;
+
+    char text[WINDOW_CHARS * 3 + 1];
+    int n = 0;
+    for (int i = common; i < win.want_len; i++) n += utf8_encode(win.want[i], text + n);
+    text[n] = '\0';
+
+    // Waiting for the previous wtype counts as queueing
+    wtype_reap();
+    for (int i = 0; i < win.n_traces; i++) {
+        stats_resume(&win.traces[i]);
+        stats_mark(STAT_QUEUE);
+        win.traces[i] = stats_handoff();
+    }
+    // The newest keystroke carries the backend stages
+    if (win.n_traces > 0) stats_resume(&win.traces[win.n_traces - 1]);
+    if (backspaces > 0 || n > 0) backend_replace(backspaces, text);
+    stats_end();
+    for (int i = 0; i + 1 < win.n_traces; i++) {
+        stats_resume(&win.traces[i]);
+        stats_end();
+    }
+    atomic_fetch_add_explicit(&merged_edits, win.n_edits - 1, memory_order_relaxed);
+}
+
+static void window_open(void) {
+    win.active = true;
+    win.deadline = stats_now() + coalesce_ns;
+    win.app_cut = win.want_cut = 0;
+    win.app_len = win.want_len = 0;
+    win.n_edits = win.n_traces = 0;
+}
+
+static void window_replace(const Command *cmd) {
+    if (win.active && win.want_len + (int)strlen(cmd->text) > WINDOW_CHARS) window_flush();
+    if (!win.active) window_open();
+
+    for (int i = 0; i < cmd->backspaces; i++) window_backspace(&win.want_cut, &win.want_len);
+    for (const char *p = cmd->text; *p;) {
+        uint32_t cp;
+        p += utf8_decode(p, &cp);
+        win.want[win.want_len++] = cp;
+    }
+    win.n_edits++;
+    if (cmd->trace.active && win.n_traces < WINDOW_TRACES) win.traces[win.n_traces++] = cmd->trace;
+}
+
+// A key the app got directly: it lands in both versions of the text
+static void window_typed(uint32_t cp) {
+    if (!win.active) return;
+    if (cp == '\b') {
+        window_backspace(&win.app_cut, &win.app_len);
+        window_backspace(&win.want_cut, &win.want_len);
+        return;
+    }
+    if (win.app_len == WINDOW_CHARS || win.want_len == WINDOW_CHARS) {
+        window_flush();
+        return;
+    }
+    win.app[win.app_len++] = cp;
+    win.want[win.want_len++] = cp;
+}
+
+// Sleep until a command is queued, the running wtype exits (it is reaped),
+// the compositor sends input method events (they are read), or timeout_ns
+// passes (-1: no limit)
+static void wait_ready(uint32_t tail, int64_t timeout_ns) {
+    atomic_store(&queue.consumer_waiting, true);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&queue.head) == tail) {
+        struct pollfd pfd[3] = {
+            { .fd = ready_fd, .events = POLLIN },
+            { .fd = wtype_pidfd, .events = POLLIN },    // Ignored when -1
+            { .fd = active == OUTPUT_IM ? im_fd() : -1, .events = POLLIN },
+        };
+        struct timespec ts = { .tv_sec = timeout_ns / 1000000000,
+                               .tv_nsec = timeout_ns % 1000000000 };
+        if (ppoll(pfd, 3, timeout_ns < 0 ? NULL : &ts, NULL) > 0) {
+            if (pfd[0].revents & POLLIN) sleep_on(ready_fd);
+            if (pfd[1].revents & POLLIN) wtype_reap();
+            if (pfd[2].revents) im_dispatch();
+        }
+    }
+    atomic_store(&queue.consumer_waiting, false);
+}
+
+// Faults on this thread still reach the flight recorder's crash handler,
+// which runs on the alternate stack (sigaltstack is per thread)
+static void emitter_altstack(void) {
+    static char altstack[64 * 1024];
+    stack_t ss = { .ss_sp = altstack, .ss_size = sizeof(altstack) };
+    sigaltstack(&ss, NULL);
+}
+
+static void *emitter_main(void *arg) {
+    (void)arg;
+    emitter_altstack();
+    for (;;) {
+        uint32_t tail = atomic_load_explicit(&queue.tail, memory_order_relaxed);
+        if (atomic_load_explicit(&queue.head, memory_order_acquire) == tail) {
+            if (!win.active) {
+                wait_ready(tail, -1);
+                continue;
+            }
+            // Past the deadline the window still takes edits while the
+            // previous wtype runs: they would wait for it anyway
+            uint64_t now = stats_now();
+            if (now < win.deadline) wait_ready(tail, (int64_t)(win.deadline - now));
+            else if (wtype_pid >= 0) wait_ready(tail, -1);
+            else window_flush();
+            continue;
+        }
+
+        const Command *cmd = &queue.slots[tail & (QUEUE_SIZE - 1)];
+        if (cmd->kind == CMD_REPLACE && coalesce_ns > 0) {
+            window_replace(cmd);
+        } else if (cmd->kind == CMD_TYPED) {
+            if (cmd->value) window_typed((uint32_t)cmd->value);
+            else window_flush();
+            backend_typed((uint32_t)cmd->value);
+        } else {
+            // Anything else must not overtake the held edit
+            window_flush();
+            if (cmd->kind == CMD_STOP || cmd->kind == CMD_FLUSH) wtype_reap();
+            if (cmd->kind == CMD_STOP) break;
+            if (cmd->kind == CMD_FORWARD) {
+                backend_forward(cmd->fd, cmd->type, cmd->code, cmd->value);
+            } else if (cmd->kind == CMD_REPLACE) {
+                wtype_reap();
+                stats_resume(&cmd->trace);
+                stats_mark(STAT_QUEUE);
+                backend_replace(cmd->backspaces, cmd->text);
+                stats_end();
+            }
+        }
+
+        // The slot is reused only after this
+        atomic_store(&queue.tail, tail + 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load(&queue.producer_waiting)) wake(space_fd);
+    }
+    return NULL;
+}
+
+static int emitter_start(void) {
+    atomic_store(&queue.head, 0);
+    atomic_store(&queue.tail, 0);
+    ready_fd = eventfd(0, EFD_CLOEXEC);
+    space_fd = eventfd(0, EFD_CLOEXEC);
+
+    // Signals stay with the main thread, where they interrupt epoll_wait;
+    // a fault is handled by the thread that caused it
+    sigset_t all, old;
+    sigfillset(&all);
+    static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+        sigdelset(&all, crash_signals[i]);
+    }
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = (ready_fd < 0 || space_fd < 0) ? -1 :
+             pthread_create(&emitter, NULL, emitter_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (rc != 0) {
+        fprintf(stderr, "Cannot start output thread, emitting inline\n");
+        if (ready_fd >= 0) close(ready_fd);
+        if (space_fd >= 0) close(space_fd);
+        ready_fd = space_fd = -1;
+        return -1;
+    }
+    emitter_running = true;
+    return 0;
+}
+
+// Let the queue drain, then stop the thread
+static void emitter_stop(void) {
+    if (!emitter_running) return;
+    Command stop = { .kind = CMD_STOP };
+    enqueue(&stop);
+    pthread_join(emitter, NULL);
+    close(ready_fd);
+    close(space_fd);
+    ready_fd = space_fd = -1;
+    emitter_running = false;
+}
+
+// Edit as commands; a text longer than one slot is cut at UTF-8 boundaries
+static void enqueue_replace(int bs_count, const char *text) {
+    Command cmd = { .kind = CMD_REPLACE, .backspaces = bs_count };
+    cmd.trace = stats_handoff();
+    size_t left = text ? strlen(text) : 0;
+    do {
+        size_t n = left;
+        if (n >= CMD_TEXT_MAX) {
+            n = CMD_TEXT_MAX - 1;
+            while (n > 0 && ((unsigned char)text[n] & 0xC0) == 0x80) n--;
+        }
+        memcpy(cmd.text, text, n);
+        cmd.text[n] = '\0';
+        enqueue(&cmd);
+        text += n;
+        left -= n;
+        cmd.backspaces = 0;
+        cmd.trace = (StatsTrace){0};
+    } while (left > 0);
+}
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+int output_init(OutputMode mode) {
+    memset(&stats, 0, sizeof(stats));
+    atomic_store(&merged_edits, 0);
+
+    if (mode == OUTPUT_MEMORY) {
+        memory_open();
+        active = OUTPUT_MEMORY;
+        return 0;
+    }
+    if (mode == OUTPUT_IM) {
+        if (im_open() < 0) return -1;
+        active = OUTPUT_IM;
+        emitter_start();
+        return 0;
+    }
+    // uinput types non-ASCII as Ctrl+Shift+U, which only GTK/IBus
+    // understand: it is used when asked for, or when there is no wtype
+    if (mode == OUTPUT_UINPUT || (mode == OUTPUT_AUTO && !wtype_available())) {
+        uinput_fd = uinput_open();
+        if (uinput_fd < 0) {
+            fprintf(stderr, "Cannot open /dev/uinput: %s\n", strerror(errno));
+            return -1;
+        }
+        if (mode == OUTPUT_AUTO)
+            fprintf(stderr, "wtype not found, using uinput "
+                    "(accented letters need Ctrl+Shift+U support)\n");
+        active = OUTPUT_UINPUT;
+        emitter_start();
+        return 0;
+    }
+    active = OUTPUT_WTYPE;
+    emitter_start();
+    return 0;
+}
+
+void output_cleanup(void) {
+    emitter_stop();
+    im_close();
+    n_fwd = 0;
+    fwd_fd = fwd_shift[0] = fwd_shift[1] = -1;
+    if (uinput_fd >= 0) {
+        ioctl(uinput_fd, UI_DEV_DESTROY);
+        close(uinput_fd);
+        uinput_fd = -1;
+    }
+    free(mem_text);
+    free(mem_utf8);
+    mem_text = NULL;
+    mem_utf8 = NULL;
+    mem_len = mem_cap = 0;
+}
+
+void output_replace(int bs_count, const char *text) {
+    stats.edits++;
+    stats.backspaces += bs_count;
+    for (const char *p = text; p && *p; p++) {
+        if ((*p & 0xC0) != 0x80) stats.chars++;
+    }
+
+    if (emitter_running) enqueue_replace(bs_count, text);
+    else backend_replace(bs_count, text);
+}
+
+void output_forward(int fd, int type, int code, int value) {
+    if (emitter_running) {
+        Command cmd = { .kind = CMD_FORWARD, .type = (uint16_t)type, .code = (uint16_t)code,
+                        .fd = fd, .value = value };
+        enqueue(&cmd);
+    } else {
+        backend_forward(fd, type, code, value);
+    }
+}
+
+void output_forward_close(int fd) {
+    // Once the queue is drained the output thread no longer touches fd
+    output_sync();
+    if (fwd_fd == fd) {
+        n_fwd = 0;
+        fwd_fd = -1;
+    }
+    if (fwd_shift[0] == fd) fwd_shift[0] = -1;
+    if (fwd_shift[1] == fd) fwd_shift[1] = -1;
+}
+
+void output_sync(void) {
+    if (!emitter_running) return;
+    Command flush = { .kind = CMD_FLUSH };
+    enqueue(&flush);
+    wait_for_tail(atomic_load(&queue.head), 0);
+}
+
+void output_set_coalesce(int us) {
+    coalesce_ns = us > 0 ? (uint64_t)us * 1000 : 0;
+}
+
+void output_typed(uint32_t cp) {
+    // Inline (the output thread did not start): no coalescing window, but
+    // the input method still needs the key for its byte counts, or its
+    // next delete_surrounding_text would cut into older characters
+    if (!emitter_running) {
+        backend_typed(cp);
+        return;
+    }
+    if (coalesce_ns == 0 && active != OUTPUT_IM) return;
+    Command cmd = { .kind = CMD_TYPED, .value = (int32_t)cp };
+    enqueue(&cmd);
+}
+
+static void backend_replace(int bs_count, const char *text) {
+    switch (active) {
+        case OUTPUT_UINPUT: uinput_replace(bs_count, text); break;
+        case OUTPUT_MEMORY: memory_replace(bs_count, text); break;
+        case OUTPUT_IM: im_replace(bs_count, text); break;
+        default: wtype_replace(bs_count, text); break;
+    }
+}
+
+static void backend_forward(int fd, int type, int code, int value) {
+    switch (active) {
+        case OUTPUT_UINPUT: uinput_forward(fd, type, code, value); break;
+        case OUTPUT_MEMORY: if (type == EV_KEY) output_memory_key(code, value); break;
+        default: break;
+    }
+}
+
+static void backend_typed(uint32_t cp) {
+    if (active == OUTPUT_IM) im_typed(cp);
+}
+
+const char *output_backend_name(void) {
+    switch (active) {
+        case OUTPUT_UINPUT: return "uinput";
+        case OUTPUT_MEMORY: return "memory";
+        case OUTPUT_IM: return "wayland-im";
+        default: return "wtype";
+    }
+}
+
+void output_get_stats(OutputStats *out) {
+    *out = stats;
+    out->merged = atomic_load_explicit(&merged_edits, memory_order_relaxed);
+}
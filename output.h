@@ -0,0 +1,67 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Output backends used to edit the focused application's text
+typedef enum {
+    OUTPUT_AUTO,        // wtype, or uinput when wtype is not installed
+    OUTPUT_UINPUT,      // Persistent /dev/uinput keyboard (non-ASCII: Ctrl+Shift+U)
+    OUTPUT_WTYPE,       // posix_spawn wtype per edit
+    OUTPUT_IM,          // Wayland input method (zwp_input_method_v2)
+    OUTPUT_MEMORY       // In-memory text field (replay)
+} OutputMode;
+
+// Emitted edit counters
+typedef struct {
+    long edits;
+    long backspaces;
+    long chars;
+    long merged;        // Edits folded into a later one (coalescing)
+} OutputStats;
+
+// Open the output backend
+int output_init(OutputMode mode);
+
+// Cleanup
+void output_cleanup(void);
+
+// Delete bs_count characters, then type UTF-8 text. Every backend but
+// memory applies it on the output thread, in call order with output_forward()
+void output_replace(int bs_count, const char *text);
+
+// Pass one raw evdev event through unchanged (grab mode) to fd, the
+// uinput copy of the keyboard it came from. uinput queues it and writes the
+// frame at EV_SYN; memory ignores fd and feeds it to the text field
+void output_forward(int fd, int type, int code, int value);
+
+// Before a keyboard's uinput copy is destroyed: wait until nothing queued
+// still writes to it and forget its held keys
+void output_forward_close(int fd);
+
+// Hold edits for us microseconds and send the edits made meanwhile as one
+// net edit, 0 = off (before init; not for memory)
+void output_set_coalesce(int us);
+
+// A key reached the app without us (no grab): its character, '\b' for
+// backspace, 0 for anything else (flushes the coalescing window). Feeds the
+// coalescing model and the input method's byte counts
+void output_typed(uint32_t cp);
+
+// Wait until every edit and forwarded event so far has been applied
+void output_sync(void);
+
+// Name of the active backend ("uinput", "wtype", "wayland-im" or "memory")
+const char *output_backend_name(void);
+
+// Counters since output_init()
+void output_get_stats(OutputStats *stats);
+
+// Memory backend: a raw key event reaching the emulated text field
+void output_memory_key(int code, int value);
+
+// Memory backend: current text as UTF-8 (valid until the next call)
+const char *output_memory_text(void);
+
+#endif
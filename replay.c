@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include "replay.h"
+#include "keyboard.h"
+#include "output.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <linux/input.h>
+
+// Capture file layout (native byte order):
+//   header:  "UKEV", uint16 version, uint16 record size, uint64 start time (us)
+//   records: uint32 delta_us, uint16 type, uint16 code, int32 value
+#define CAPTURE_MAGIC   "UKEV"
+#define CAPTURE_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t start_us;
+} CaptureHeader;
+
+typedef struct {
+    uint32_t delta_us;
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+} CaptureRecord;
+
+static FILE *record_file = NULL;
+static uint64_t last_us = 0;
+
+static inline uint64_t event_us(const struct input_event *ev) {
+    return (uint64_t)ev->input_event_sec * 1000000 + ev->input_event_usec;
+}
+
+// ============================================================================
+// RECORDING
+// ============================================================================
+
+int replay_record_open(const char *path) {
+    record_file = fopen(path, "wb");
+    if (!record_file) return -1;
+    setvbuf(record_file, NULL, _IOFBF, 64 * 1024);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    last_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    CaptureHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CAPTURE_MAGIC, 4);
+    h.version = CAPTURE_VERSION;
+    h.record_size = sizeof(CaptureRecord);
+    h.start_us = last_us;
+    if (fwrite(&h, sizeof(h), 1, record_file) != 1) {
+        fclose(record_file);
+        record_file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void replay_record(const struct input_event *ev) {
+    if (!record_file) return;
+
+    uint64_t us = event_us(ev);
+    uint64_t delta = us > last_us ? us - last_us : 0;
+    last_us = us;
+
+    CaptureRecord r;
+    r.delta_us = delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta;
+    r.type = ev->type;
+    r.code = ev->code;
+    r.value = ev->value;
+    fwrite(&r, sizeof(r), 1, record_file);
+}
+
+void replay_record_close(void) {
+    if (record_file) {
+        fclose(record_file);
+        record_file = NULL;
+    }
+}
+
+// ============================================================================
+// REPLAY
+// ============================================================================
+
+static inline long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static CaptureRecord *load_capture(const char *path, CaptureHeader *h, long *count) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    if (fread(h, sizeof(*h), 1, f) != 1 || memcmp(h->magic, CAPTURE_MAGIC, 4) != 0 ||
+        h->version != CAPTURE_VERSION || h->record_size != sizeof(CaptureRecord)) {
+        fprintf(stderr, "%s: not a UniKey capture file\n", path);
+        fclose(f);
+        return NULL;
+    }
+
+    long cap = 4096, n = 0;
+    CaptureRecord *recs = malloc(sizeof(CaptureRecord) * cap);
+    while (recs) {
+        if (n == cap) {
+            cap *= 2;
+            CaptureRecord *p = realloc(recs, sizeof(CaptureRecord) * cap);
+            if (!p) { free(recs); recs = NULL; break; }
+            recs = p;
+        }
+        size_t got = fread(&recs[n], sizeof(CaptureRecord), cap - n, f);
+        n += (long)got;
+        if (n < cap) break;
+    }
+    fclose(f);
+
+    *count = n;
+    return recs;
+}
+
+int replay_run(const char *path) {
+    CaptureHeader h;
+    long n = 0;
+    CaptureRecord *recs = load_capture(path, &h, &n);
+    if (!recs) return -1;
+
+    if (output_init(OUTPUT_MEMORY) < 0) {
+        free(recs);
+        return -1;
+    }
+
+    long long *samples = malloc(sizeof(long long) * (n ? n : 1));
+    if (!samples) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        free(recs);
+        output_cleanup();
+        return -1;
+    }
+    long keys = 0, presses = 0;
+    uint64_t us = h.start_us;
+    long long total = 0;
+
+    for (long i = 0; i < n; i++) {
+        struct input_event ev;
+        memset(&ev, 0, sizeof(ev));
+        us += recs[i].delta_us;
+        ev.input_event_sec = us / 1000000;
+        ev.input_event_usec = us % 1000000;
+        ev.type = recs[i].type;
+        ev.code = recs[i].code;
+        ev.value = recs[i].value;
+
+        // Without a grab the raw key reaches the app before we react to it;
+        // with one, keyboard.c forwards what it does not consume
+        if (ev.type == EV_KEY) {
+            if (!keyboard_is_grabbing()) output_memory_key(ev.code, ev.value);
+            if (ev.value == 1) presses++;
+        }
+
+        long long t0 = now_ns();
+        keyboard_handle_event(&ev);
+        long long dt = now_ns() - t0;
+        total += dt;
+        if (ev.type == EV_KEY) samples[keys++] = dt;
+    }
+
+    OutputStats st;
+    output_get_stats(&st);
+
+    printf("Replay: %ld events, %ld key presses, %.1fs captured\n",
+           n, presses, (us - h.start_us) / 1e6);
+    printf("Edits: %ld, backspaces: %ld, chars typed: %ld\n",
+           st.edits, st.backspaces, st.chars);
+    if (keys > 0) {
+        qsort(samples, keys, sizeof(long long), cmp_ll);
+        printf("Pipeline: %.1f ns/event, %.2fM events/s, p50=%lldns p99=%lldns p999=%lldns\n",
+               (double)total / n, n * 1e3 / (total ? total : 1),
+               samples[(keys - 1) / 2], samples[(long)((keys - 1) * 0.99)],
+               samples[(long)((keys - 1) * 0.999)]);
+    }
+    printf("Text:\n%s\n", output_memory_text());
+
+    free(samples);
+    free(recs);
+    output_cleanup();
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+
+struct input_event;
+
+// Start recording raw evdev events to a capture file
+int replay_record_open(const char *path);
+
+// Append one event (no-op when not recording)
+void replay_record(const struct input_event *ev);
+
+// Flush and close the capture file
+void replay_record_close(void);
+
+// Replay a capture file through keyboard_handle_event() into the memory
+// output backend, then print the resulting text and timing stats
+int replay_run(const char *path);
+
+#endif
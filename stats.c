@@ -0,0 +1,198 @@
+#define _GNU_SOURCE
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
+
+// Bucket layout: values below 32 are exact, then every power of two is
+// split in 32 equal sub-buckets, up to 2^42 ns (73 min)
+#define SUB_BITS    5
+#define SUB_COUNT   (1 << SUB_BITS)
+#define MAX_EXP     41
+#define N_BUCKETS   (SUB_COUNT * (MAX_EXP - SUB_BITS + 2))
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[N_BUCKETS];
+} Histogram;
+
+static Histogram hists[STAT_COUNT];
+static const char *report_path = NULL;
+static volatile sig_atomic_t report_requested = 0;
+
+static const char *const stage_names[STAT_COUNT] = {
+    [STAT_READ] = "read",
+    [STAT_ENGINE] = "engine",
+    [STAT_QUEUE] = "queue",
+    [STAT_ENCODE] = "encode",
+    [STAT_SUBMIT] = "submit",
+    [STAT_COMPLETE] = "complete",
+    [STAT_TOTAL] = "total",
+};
+
+// Current keystroke on this thread: start is the kernel timestamp (0 if
+// unknown), last the end of the previous stage
+static _Thread_local StatsTrace trace;
+
+// ============================================================================
+// HISTOGRAMS
+// ============================================================================
+
+static inline int bucket_of(uint64_t v) {
+    if (v < SUB_COUNT) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > MAX_EXP) return N_BUCKETS - 1;
+    return SUB_COUNT * (e - SUB_BITS + 1) + (int)((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+// Largest value that lands in bucket i
+static uint64_t bucket_high(int i) {
+    if (i < SUB_COUNT) return (uint64_t)i;
+    int e = i / SUB_COUNT + SUB_BITS - 1;
+    uint64_t width = 1ull << (e - SUB_BITS);
+    return ((uint64_t)(SUB_COUNT + i % SUB_COUNT) << (e - SUB_BITS)) + width - 1;
+}
+
+void stats_record(StatStage stage, uint64_t ns) {
+    Histogram *h = &hists[stage];
+    atomic_fetch_add_explicit(&h->buckets[bucket_of(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, ns, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (ns > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &max, ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+uint64_t stats_percentile(StatStage stage, double q) {
+    const Histogram *h = &hists[stage];
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    if (count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(q * (double)(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < N_BUCKETS; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (seen >= rank) {
+            // Bucket edges overshoot the recorded maximum at the top
+            uint64_t high = bucket_high(i);
+            uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+            return high < max ? high : max;
+        }
+    }
+    return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+// ============================================================================
+// KEYSTROKE TRACE
+// ============================================================================
+
+void stats_begin(uint64_t event_ns) {
+    uint64_t now = stats_now();
+    trace.active = true;
+    trace.start = event_ns;
+    trace.last = now;
+    // A clock mismatch (CLOCK_REALTIME event) shows up as a negative gap
+    if (event_ns && event_ns <= now) stats_record(STAT_READ, now - event_ns);
+    else trace.start = 0;
+}
+
+void stats_mark(StatStage stage) {
+    if (!trace.active) return;
+    uint64_t now = stats_now();
+    stats_record(stage, now - trace.last);
+    trace.last = now;
+}
+
+void stats_end(void) {
+    if (!trace.active) return;
+    trace.active = false;
+    if (trace.start) stats_record(STAT_TOTAL, stats_now() - trace.start);
+}
+
+StatsTrace stats_handoff(void) {
+    StatsTrace t = trace;
+    trace.active = false;
+    return t;
+}
+
+void stats_resume(const StatsTrace *t) {
+    trace = *t;
+}
+
+// ============================================================================
+// REPORT
+// ============================================================================
+
+static void print_ns(FILE *f, uint64_t ns) {
+    if (ns < 10000) fprintf(f, " %8lluns", (unsigned long long)ns);
+    else if (ns < 10000000) fprintf(f, " %8.1fus", ns / 1e3);
+    else fprintf(f, " %8.1fms", ns / 1e6);
+}
+
+static void write_report(FILE *f) {
+    fprintf(f, "%-9s %10s %10s %10s %10s %10s %10s\n",
+            "stage", "count", "mean", "p50", "p99", "p999", "max");
+    for (int s = 0; s < STAT_COUNT; s++) {
+        const Histogram *h = &hists[s];
+        uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        uint64_t sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+        fprintf(f, "%-9s %10llu", stage_names[s], (unsigned long long)count);
+        print_ns(f, count ? sum / count : 0);
+        print_ns(f, stats_percentile(s, 0.50));
+        print_ns(f, stats_percentile(s, 0.99));
+        print_ns(f, stats_percentile(s, 0.999));
+        print_ns(f, atomic_load_explicit(&h->max, memory_order_relaxed));
+        fputc('\n', f);
+    }
+}
+
+void stats_dump(void) {
+    if (!report_path) {
+        write_report(stderr);
+        return;
+    }
+
+    // Readers never see a half-written report
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", report_path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return;
+    }
+    write_report(f);
+    if (fclose(f) != 0 || rename(tmp, report_path) < 0) {
+        perror(report_path);
+        remove(tmp);
+    }
+}
+
+static void usr1_handler(int sig) {
+    (void)sig;
+    report_requested = 1;
+}
+
+void stats_init(const char *path) {
+    report_path = path;
+
+    // No SA_RESTART: epoll_wait returns so the main loop can write the report
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = usr1_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+void stats_poll(void) {
+    if (!report_requested) return;
+    report_requested = 0;
+    stats_dump();
+}
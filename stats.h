@@ -0,0 +1,64 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Keystroke latency, per pipeline stage, in log-linear histograms (about 3%
+// resolution up to an hour). Recording is a few relaxed atomic adds and
+// safe from any thread
+
+typedef enum {
+    STAT_READ,          // Kernel event timestamp -> event read by us
+    STAT_ENGINE,        // Telex processing, edit text included
+    STAT_QUEUE,         // Waiting for the output thread
+    STAT_ENCODE,        // Edit -> backend input (key events, wtype args)
+    STAT_SUBMIT,        // Handing it to the backend (write, spawn)
+    STAT_COMPLETE,      // Submit -> backend done (wtype exit)
+    STAT_TOTAL,         // Kernel event timestamp -> edit applied
+    STAT_COUNT
+} StatStage;
+
+// A keystroke trace moving to another thread
+typedef struct {
+    bool active;
+    uint64_t start;
+    uint64_t last;
+} StatsTrace;
+
+// CLOCK_MONOTONIC in nanoseconds (vDSO, no syscall)
+static inline uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Install the SIGUSR1 handler; the report goes to path, or stderr if NULL
+void stats_init(const char *path);
+
+// Write the report if SIGUSR1 arrived since the last call (main loop)
+void stats_poll(void);
+
+// Write the report now
+void stats_dump(void);
+
+// Add one sample in nanoseconds
+void stats_record(StatStage stage, uint64_t ns);
+
+// Keystroke trace on the calling thread: begin at the kernel timestamp
+// (CLOCK_MONOTONIC ns, 0 = unknown), mark the end of each stage, then end.
+// Marks outside a trace are ignored
+void stats_begin(uint64_t event_ns);
+void stats_mark(StatStage stage);
+void stats_end(void);
+
+// Take the trace off this thread (the stage clock keeps running) and
+// continue it on another one; resuming an inactive trace does nothing
+StatsTrace stats_handoff(void);
+void stats_resume(const StatsTrace *trace);
+
+// Percentile of one stage in ns (q in 0..1), 0 when empty
+uint64_t stats_percentile(StatStage stage, double q);
+
+#endif
@@ -1,49 +1,8 @@
 #include "telex.h"
+#include "telex_data.h"
+#include "telex_tables.h"
 #include <string.h>
-#include <ctype.h>
-
-// Vietnamese vowels with tones
-// Rows: base vowel variants, Columns: tones (0=none, 1=sắc, 2=huyền, 3=hỏi, 4=ngã, 5=nặng)
-static const uint32_t vowel_table[][6] = {
-    {'a', 0x00E1, 0x00E0, 0x1EA3, 0x00E3, 0x1EA1},  // 0: a
-    {'A', 0x00C1, 0x00C0, 0x1EA2, 0x00C3, 0x1EA0},  // 1: A
-    {0x0103, 0x1EAF, 0x1EB1, 0x1EB3, 0x1EB5, 0x1EB7},  // 2: ă
-    {0x0102, 0x1EAE, 0x1EB0, 0x1EB2, 0x1EB4, 0x1EB6},  // 3: Ă
-    {0x00E2, 0x1EA5, 0x1EA7, 0x1EA9, 0x1EAB, 0x1EAD},  // 4: â
-    {0x00C2, 0x1EA4, 0x1EA6, 0x1EA8, 0x1EAA, 0x1EAC},  // 5: Â
-    {'e', 0x00E9, 0x00E8, 0x1EBB, 0x1EBD, 0x1EB9},  // 6: e
-    {'E', 0x00C9, 0x00C8, 0x1EBA, 0x1EBC, 0x1EB8},  // 7: E
-    {0x00EA, 0x1EBF, 0x1EC1, 0x1EC3, 0x1EC5, 0x1EC7},  // 8: ê
-    {0x00CA, 0x1EBE, 0x1EC0, 0x1EC2, 0x1EC4, 0x1EC6},  // 9: Ê
-    {'i', 0x00ED, 0x00EC, 0x1EC9, 0x0129, 0x1ECB},  // 10: i
-    {'I', 0x00CD, 0x00CC, 0x1EC8, 0x0128, 0x1ECA},  // 11: I
-    {'o', 0x00F3, 0x00F2, 0x1ECF, 0x00F5, 0x1ECD},  // 12: o
-    {'O', 0x00D3, 0x00D2, 0x1ECE, 0x00D5, 0x1ECC},  // 13: O
-    {0x00F4, 0x1ED1, 0x1ED3, 0x1ED5, 0x1ED7, 0x1ED9},  // 14: ô
-    {0x00D4, 0x1ED0, 0x1ED2, 0x1ED4, 0x1ED6, 0x1ED8},  // 15: Ô
-    {0x01A1, 0x1EDB, 0x1EDD, 0x1EDF, 0x1EE1, 0x1EE3},  // 16: ơ
-    {0x01A0, 0x1EDA, 0x1EDC, 0x1EDE, 0x1EE0, 0x1EE2},  // 17: Ơ
-    {'u', 0x00FA, 0x00F9, 0x1EE7, 0x0169, 0x1EE5},  // 18: u
-    {'U', 0x00DA, 0x00D9, 0x1EE6, 0x0168, 0x1EE4},  // 19: U
-    {0x01B0, 0x1EE9, 0x1EEB, 0x1EED, 0x1EEF, 0x1EF1},  // 20: ư
-    {0x01AF, 0x1EE8, 0x1EEA, 0x1EEC, 0x1EEE, 0x1EF0},  // 21: Ư
-    {'y', 0x00FD, 0x1EF3, 0x1EF7, 0x1EF9, 0x1EF5},  // 22: y
-    {'Y', 0x00DD, 0x1EF2, 0x1EF6, 0x1EF8, 0x1EF4},  // 23: Y
-};
-
-#define VOWEL_ROWS 24
-#define BASE_A  0
-#define BASE_AW 2
-#define BASE_AA 4
-#define BASE_E  6
-#define BASE_EE 8
-#define BASE_I  10
-#define BASE_O  12
-#define BASE_OO 14
-#define BASE_OW 16
-#define BASE_U  18
-#define BASE_UW 20
-#define BASE_Y  22
+#include <stddef.h>
 
 // ============================================================================
 // CONSONANT DEFINITIONS FOR CVC EXTRACTION
@@ -61,67 +20,134 @@ void telex_reset(Word *word) {
     word->len = 0;
     word->cancelled_tone = 0;
     word->history_len = 0;
+    word->vo_start = NO_POS;
+    word->vo_end = 0;
+    word->tone_at = NO_POS;
 }
 
-// Record a transformation in history
-static void record_transform(Word *word, TransformType type, int pos,
-                            uint32_t old_ch, uint32_t new_ch, char key) {
-    if (word->history_len >= MAX_HISTORY) return;
-    Transformation *t = &word->history[word->history_len++];
-    t->type = type;
-    t->target_pos = pos;
-    t->old_char = old_ch;
-    t->new_char = new_ch;
-    t->key = key;
+_Static_assert(sizeof(Word) <= 128, "Word must fit in two cache lines");
+_Static_assert(offsetof(Word, history) == 64, "history must start the second cache line");
+_Static_assert((MAX_HISTORY & (MAX_HISTORY - 1)) == 0, "MAX_HISTORY must be a power of two");
+
+// Constant-time vowel lookup: packed (row, tone) or VOWEL_NONE
+static inline uint8_t vowel_info(uint32_t ch) {
+    if (ch < VOWEL_INDEX_LO_END) return vowel_index_lo[ch];
+    if (ch - VOWEL_INDEX_HI_START < VOWEL_INDEX_HI_END - VOWEL_INDEX_HI_START)
+        return vowel_index_hi[ch - VOWEL_INDEX_HI_START];
+    return VOWEL_NONE;
+}
+
+static inline int find_vowel_row(uint32_t ch) {
+    uint8_t v = vowel_info(ch);
+    return v == VOWEL_NONE ? -1 : VI_ROW(v);
+}
+
+static inline int get_tone(uint32_t ch) {
+    uint8_t v = vowel_info(ch);
+    return v == VOWEL_NONE ? 0 : VI_TONE(v);
+}
+
+static inline bool is_vowel(uint32_t ch) {
+    return vowel_info(ch) != VOWEL_NONE;
+}
+
+static inline uint32_t get_vowel(int base, bool upper, int tone) {
+    int row = base + (upper ? 1 : 0);
+    return (row >= 0 && row < VOWEL_ROWS) ? vowel_table[row][tone] : 0;
+}
+
+static inline Transformation *history_at(Word *word, uint8_t n) {
+    return &word->history[n & (MAX_HISTORY - 1)];
 }
 
-// Fast vowel lookup using cache
-static int find_vowel_row(uint32_t ch) {
-    // Quick ASCII check
-    if (ch < 128) {
-        switch (ch) {
-            case 'a': return 0; case 'A': return 1;
-            case 'e': return 6; case 'E': return 7;
-            case 'i': return 10; case 'I': return 11;
-            case 'o': return 12; case 'O': return 13;
-            case 'u': return 18; case 'U': return 19;
-            case 'y': return 22; case 'Y': return 23;
-            default: return -1;
+// ============================================================================
+// SYLLABLE STRUCTURE
+// ============================================================================
+
+static void find_tone_at(Word *word) {
+    word->tone_at = NO_POS;
+    for (int i = 0; i < word->len; i++) {
+        if (get_tone(word->chars[i]) > 0) {
+            word->tone_at = (uint8_t)i;
+            return;
         }
     }
-    // Full table search for Unicode
-    for (int i = 0; i < VOWEL_ROWS; i++) {
-        for (int j = 0; j < 6; j++) {
-            if (vowel_table[i][j] == ch) return i;
+}
+
+bool telex_append(Word *word, uint32_t ch) {
+    if (word->len >= MAX_WORD_LEN - 1) return false;
+
+    uint8_t v = vowel_info(ch);
+    if (v != VOWEL_NONE) {
+        if (word->vo_start == NO_POS) {
+            word->vo_start = word->len;
+            word->vo_end = word->len + 1;
+        } else if (word->vo_end == word->len) {
+            word->vo_end++;  // Cluster still open
         }
+        if (VI_TONE(v) > 0 && word->tone_at == NO_POS) word->tone_at = word->len;
     }
-    return -1;
+    word->chars[word->len++] = (uint16_t)ch;
+    return true;
 }
 
-static inline int get_tone(uint32_t ch) {
-    int row = find_vowel_row(ch);
-    if (row < 0) return 0;
-    for (int j = 0; j < 6; j++) {
-        if (vowel_table[row][j] == ch) return j;
+void telex_backspace(Word *word) {
+    if (word->len == 0) return;
+
+    int pos = --word->len;
+    if (word->vo_start == pos) word->vo_start = NO_POS;
+    else if (word->vo_start != NO_POS && word->vo_end == pos + 1) word->vo_end = (uint8_t)pos;
+    if (word->tone_at == pos) find_tone_at(word);
+}
+
+// Record a transformation in history (the ring overwrites the oldest).
+// Tones and marks keep a vowel a vowel and đ a consonant, so only the
+// tone position can move
+static void record_transform(Word *word, TransformType type, int pos,
+                            uint32_t old_ch, uint32_t new_ch, char key) {
+    Transformation *t = history_at(word, word->history_len++);
+    t->type = (uint8_t)type;
+    t->target_pos = (uint8_t)pos;
+    t->old_char = (uint16_t)old_ch;
+    t->new_char = (uint16_t)new_ch;
+    t->key = key;
+
+    if (get_tone(new_ch) > 0) {
+        if (word->tone_at == NO_POS || pos < word->tone_at) word->tone_at = (uint8_t)pos;
+    } else if (word->tone_at == pos) {
+        find_tone_at(word);
     }
-    return 0;
 }
 
-static inline bool is_vowel(uint32_t ch) {
-    return find_vowel_row(ch) >= 0;
+TelexCheckpoint telex_checkpoint(const Word *word) {
+    TelexCheckpoint cp = { word->len, word->cancelled_tone, word->history_len };
+    return cp;
 }
 
-static inline int get_base_type(int row) {
-    return (row / 2) * 2;
+// Records since a checkpoint; a single key never wraps the ring
+static inline int records_since(const Word *word, TelexCheckpoint cp) {
+    return (uint8_t)(word->history_len - cp.history_len);
 }
 
-static inline bool is_upper_row(int row) {
-    return (row % 2) == 1;
+void telex_rollback(Word *word, TelexCheckpoint cp) {
+    int n = records_since(word, cp);
+    for (int i = n; i > 0; i--) {
+        Transformation *t = history_at(word, --word->history_len);
+        word->chars[t->target_pos] = t->old_char;
+    }
+    while (word->len > cp.len) telex_backspace(word);
+    word->cancelled_tone = cp.cancelled_tone;
+    if (n > 0) find_tone_at(word);
 }
 
-static inline uint32_t get_vowel(int base, bool upper, int tone) {
-    int row = base + (upper ? 1 : 0);
-    return (row >= 0 && row < VOWEL_ROWS) ? vowel_table[row][tone] : 0;
+int telex_changed_from(const Word *word, TelexCheckpoint cp) {
+    int start = cp.len;
+    uint8_t h = cp.history_len;
+    for (int n = records_since(word, cp); n > 0; n--, h++) {
+        int pos = word->history[h & (MAX_HISTORY - 1)].target_pos;
+        if (pos < start) start = pos;
+    }
+    return start;
 }
 
 // Get the base (toneless) form of a vowel
@@ -135,6 +161,7 @@ static inline uint32_t get_base_vowel(uint32_t ch) {
 // CVC EXTRACTION (from bamboo-core)
 // ============================================================================
 
+// O(1): boundaries are maintained on the Word as it is typed
 bool telex_extract_cvc(const Word *word, CVCInfo *cvc) {
     memset(cvc, 0, sizeof(CVCInfo));
     cvc->fc_start = cvc->fc_end = -1;
@@ -143,30 +170,26 @@ bool telex_extract_cvc(const Word *word, CVCInfo *cvc) {
 
     if (word->len == 0) return false;
 
-    int i = 0;
-
-    // Find first consonant cluster
-    while (i < word->len && !is_vowel(word->chars[i])) {
-        if (cvc->fc_start < 0) cvc->fc_start = i;
-        cvc->fc_end = i;
+    // First consonant cluster (the whole word while there is no vowel)
+    int fc_len = word->vo_start == NO_POS ? word->len : word->vo_start;
+    if (fc_len > 0) {
+        cvc->fc_start = 0;
+        cvc->fc_end = fc_len - 1;
         cvc->has_fc = true;
-        i++;
     }
 
-    // Find vowel cluster
-    while (i < word->len && is_vowel(word->chars[i])) {
-        if (cvc->vo_start < 0) cvc->vo_start = i;
-        cvc->vo_end = i;
+    if (word->vo_start != NO_POS) {
+        // Vowel cluster
+        cvc->vo_start = word->vo_start;
+        cvc->vo_end = word->vo_end - 1;
         cvc->has_vo = true;
-        i++;
-    }
 
-    // Find last consonant cluster
-    while (i < word->len) {
-        if (cvc->lc_start < 0) cvc->lc_start = i;
-        cvc->lc_end = i;
-        cvc->has_lc = true;
-        i++;
+        // Last consonant cluster: everything after it
+        if (word->vo_end < word->len) {
+            cvc->lc_start = word->vo_end;
+            cvc->lc_end = word->len - 1;
+            cvc->has_lc = true;
+        }
     }
 
     // Special case: "gi" and "qu" are considered first consonants
@@ -264,19 +287,16 @@ static int segment_to_str(const Word *word, int start, int end, char *buf, int b
     for (int i = start; i <= end && pos < bufsize - 4; i++) {
         uint32_t ch = word->chars[i];
         // Get base form for vowels (remove tones/marks for matching)
-        if (is_vowel(ch)) {
-            int row = find_vowel_row(ch);
-            if (row >= 0) {
-                int base = get_base_type(row);
-                // Map to simple vowel
-                switch (base) {
-                    case BASE_A: case BASE_AW: case BASE_AA: ch = 'a'; break;
-                    case BASE_E: case BASE_EE: ch = 'e'; break;
-                    case BASE_I: ch = 'i'; break;
-                    case BASE_O: case BASE_OO: case BASE_OW: ch = 'o'; break;
-                    case BASE_U: case BASE_UW: ch = 'u'; break;
-                    case BASE_Y: ch = 'y'; break;
-                }
+        uint8_t v = vowel_info(ch);
+        if (v != VOWEL_NONE) {
+            // Map to simple vowel
+            switch (VI_BASE(v)) {
+                case BASE_A: case BASE_AW: case BASE_AA: ch = 'a'; break;
+                case BASE_E: case BASE_EE: ch = 'e'; break;
+                case BASE_I: ch = 'i'; break;
+                case BASE_O: case BASE_OO: case BASE_OW: ch = 'o'; break;
+                case BASE_U: case BASE_UW: ch = 'u'; break;
+                case BASE_Y: ch = 'y'; break;
             }
         }
         // Convert to lowercase
@@ -344,11 +364,11 @@ bool telex_is_valid_syllable(const Word *word) {
         }
     }
 
-    // Validate tone for restricted endings
-    for (int i = 0; i < word->len; i++) {
-        int tone = get_tone(word->chars[i]);
-        if (tone > 0 && !telex_is_valid_tone(word, tone)) {
-            return false;
+    // Validate tone for restricted endings (c/p/t/ch: only sắc/nặng)
+    if (has_restricted_ending(word, &cvc)) {
+        for (int i = 0; i < word->len; i++) {
+            int tone = get_tone(word->chars[i]);
+            if (tone >= 2 && tone <= 4) return false;
         }
     }
 
@@ -359,67 +379,34 @@ bool telex_is_valid_syllable(const Word *word) {
 // VOWEL POSITION FINDING
 // ============================================================================
 
-// Find all vowel positions
-static int find_vowel_positions(const Word *word, int *pos, int max) {
-    int count = 0;
-    for (int i = 0; i < word->len && count < max; i++) {
-        if (is_vowel(word->chars[i])) pos[count++] = i;
-    }
-    return count;
-}
-
-// Check for final consonant
-static bool has_final_consonant(const Word *word, int after_pos) {
-    for (int i = after_pos + 1; i < word->len; i++) {
-        if (!is_vowel(word->chars[i])) return true;
-    }
-    return false;
-}
-
-// Smart tone position (Vietnamese rules + freedom typing)
+// Smart tone position (Vietnamese rules + freedom typing, see gen_tables.c)
 static int find_tone_position(const Word *word) {
-    int pos[MAX_WORD_LEN];
-    int count = find_vowel_positions(word, pos, MAX_WORD_LEN);
-
-    if (count == 0) return -1;
-    if (count == 1) return pos[0];
-
-    // Find vowel cluster
-    int cs = pos[0], ce = pos[0];
-    for (int i = 1; i < count; i++) {
-        if (pos[i] == ce + 1) ce = pos[i];
-    }
-    int clen = ce - cs + 1;
-
-    // Priority: ơ, ê get the tone
-    for (int i = cs; i <= ce; i++) {
-        int row = find_vowel_row(word->chars[i]);
-        if (row >= 0) {
-            int base = get_base_type(row);
-            if (base == BASE_OW || base == BASE_EE) return i;
+    if (word->vo_start == NO_POS) return -1;
+
+    // First vowel cluster -> nucleus
+    int cs = word->vo_start;
+    int i = word->vo_end;
+    int clen = i - cs;
+    bool final_cons = i < word->len;
+    int b[NUCLEUS_MAX_LEN];
+    for (int j = 0; j < clen && j < NUCLEUS_MAX_LEN; j++) {
+        b[j] = BASE_INDEX(VI_BASE(vowel_info(word->chars[cs + j])));
+    }
+
+    if (clen > NUCLEUS_MAX_LEN) {
+        // Priority: ơ, ê get the tone, otherwise the second vowel
+        for (int j = cs; j < i; j++) {
+            int base = VI_BASE(vowel_info(word->chars[j]));
+            if (base == BASE_OW || base == BASE_EE) return j;
         }
+        return cs + 1;
     }
 
-    bool final_cons = has_final_consonant(word, ce);
-
-    if (clen == 2) {
-        int r1 = find_vowel_row(word->chars[cs]);
-        int r2 = find_vowel_row(word->chars[ce]);
-        if (r1 >= 0 && r2 >= 0) {
-            int b1 = get_base_type(r1), b2 = get_base_type(r2);
-            // oa, oe, uy patterns -> second vowel
-            if ((b1 == BASE_O || b1 == BASE_OO || b1 == BASE_OW) &&
-                (b2 == BASE_A || b2 == BASE_AW || b2 == BASE_AA || b2 == BASE_E || b2 == BASE_EE))
-                return ce;
-            if ((b1 == BASE_U || b1 == BASE_UW) &&
-                (b2 == BASE_Y || b2 == BASE_E || b2 == BASE_EE || b2 == BASE_OW || b2 == BASE_A))
-                return ce;
-        }
-        return final_cons ? ce : cs;
-    }
-
-    if (clen >= 3) return cs + 1;
-    return cs;
+    int id = clen == 1 ? NUCLEUS_ID1(b[0])
+           : clen == 2 ? NUCLEUS_ID2(b[0], b[1])
+           : NUCLEUS_ID3(b[0], b[1], b[2]);
+    uint8_t offset = tone_pos_table[id];
+    return cs + (final_cons ? offset >> 4 : offset & 0x0F);
 }
 
 // Move existing tone to correct position (smart tone movement)
@@ -427,31 +414,26 @@ static void normalize_tone_position(Word *word) {
     int correct_pos = find_tone_position(word);
     if (correct_pos < 0) return;
 
-    // Find current tone and its position
-    int current_tone = 0;
-    int current_pos = -1;
-
-    for (int i = 0; i < word->len; i++) {
-        int t = get_tone(word->chars[i]);
-        if (t > 0) {
-            current_tone = t;
-            current_pos = i;
-            break;
-        }
-    }
+    // Current tone and its position
+    int current_pos = word->tone_at == NO_POS ? -1 : word->tone_at;
+    int current_tone = current_pos < 0 ? 0 : get_tone(word->chars[current_pos]);
 
     // Move tone if needed
     if (current_tone > 0 && current_pos != correct_pos && current_pos >= 0) {
         // Remove tone from current position
         int row = find_vowel_row(word->chars[current_pos]);
         if (row >= 0) {
+            uint32_t old = word->chars[current_pos];
             word->chars[current_pos] = vowel_table[row][0];
+            record_transform(word, TRANS_TONE, current_pos, old, word->chars[current_pos], 0);
         }
 
         // Add tone to correct position
         row = find_vowel_row(word->chars[correct_pos]);
         if (row >= 0) {
+            uint32_t old = word->chars[correct_pos];
             word->chars[correct_pos] = vowel_table[row][current_tone];
+            record_transform(word, TRANS_TONE, correct_pos, old, word->chars[correct_pos], 0);
         }
     }
 }
@@ -466,10 +448,11 @@ static int apply_tone_ex(Word *word, int tone, char key) {
     int pos = find_tone_position(word);
     if (pos < 0) return 0;
 
-    int row = find_vowel_row(word->chars[pos]);
-    if (row < 0) return 0;
+    uint8_t v = vowel_info(word->chars[pos]);
+    if (v == VOWEL_NONE) return 0;
 
-    int current = get_tone(word->chars[pos]);
+    int row = VI_ROW(v);
+    int current = VI_TONE(v);
 
     // Validate tone for restricted endings (c/p/t/ch)
     if (tone > 0 && !telex_is_valid_tone(word, tone)) {
@@ -502,90 +485,47 @@ static int apply_tone_ex(Word *word, int tone, char key) {
 // VOWEL MARK HANDLERS
 // ============================================================================
 
+// UOW shortcut on the vowels at prev, last: uo -> ươ, uO -> ưƠ, ươ -> uo.
+// Returns 0 = not a u/o pair, 1 = marked, 2 = marks taken off
+static int apply_uow(Word *word, int prev, int last, char key) {
+    uint8_t v1 = vowel_info(word->chars[prev]);
+    uint8_t v2 = vowel_info(word->chars[last]);
+    if (v1 == VOWEL_NONE || v2 == VOWEL_NONE) return 0;
+
+    int b1 = BASE_INDEX(VI_BASE(v1));
+    int b2 = BASE_INDEX(VI_BASE(v2));
+    uint16_t t = uow_table[b1 * BASE_COUNT + b2];
+    if (!(t & UOW_VALID)) return 0;
+
+    TransformType type = (t & UOW_UNDO) ? TRANS_UNDO : TRANS_MARK;
+    if (UOW_B1(t) != b1) {
+        uint32_t old = word->chars[prev];
+        word->chars[prev] = get_vowel(UOW_B1(t) * 2, VI_UPPER(v1), VI_TONE(v1));
+        record_transform(word, type, prev, old, word->chars[prev], key);
+    }
+    if (UOW_B2(t) != b2) {
+        uint32_t old = word->chars[last];
+        word->chars[last] = get_vowel(UOW_B2(t) * 2, VI_UPPER(v2), VI_TONE(v2));
+        record_transform(word, type, last, old, word->chars[last], key);
+    }
+    normalize_tone_position(word);
+    return (t & UOW_UNDO) ? 2 : 1;
+}
+
 // Handle 'w' key with UOW shortcut (from bamboo-core)
 static bool handle_w(Word *word) {
-    // UOW shortcut: uo + w -> ươ, uO + w -> ưƠ
-    if (word->len >= 2) {
-        int last = word->len - 1;
-        int prev = word->len - 2;
-        uint32_t c1 = word->chars[prev];
-        uint32_t c2 = word->chars[last];
-
-        int r1 = find_vowel_row(c1);
-        int r2 = find_vowel_row(c2);
-
-        if (r1 >= 0 && r2 >= 0) {
-            int b1 = get_base_type(r1);
-            int b2 = get_base_type(r2);
-            bool u1 = is_upper_row(r1);
-            bool u2 = is_upper_row(r2);
-            int t1 = get_tone(c1);
-            int t2 = get_tone(c2);
-
-            // u + o -> ư + ơ (UOW shortcut)
-            if ((b1 == BASE_U) && (b2 == BASE_O)) {
-                uint32_t old1 = word->chars[prev];
-                uint32_t old2 = word->chars[last];
-                word->chars[prev] = get_vowel(BASE_UW, u1, t1);
-                word->chars[last] = get_vowel(BASE_OW, u2, t2);
-                record_transform(word, TRANS_MARK, prev, old1, word->chars[prev], 'w');
-                record_transform(word, TRANS_MARK, last, old2, word->chars[last], 'w');
-                normalize_tone_position(word);
-                return true;
-            }
-
-            // ư + o -> ư + ơ
-            if ((b1 == BASE_UW) && (b2 == BASE_O)) {
-                uint32_t old = word->chars[last];
-                word->chars[last] = get_vowel(BASE_OW, u2, t2);
-                record_transform(word, TRANS_MARK, last, old, word->chars[last], 'w');
-                normalize_tone_position(word);
-                return true;
-            }
-
-            // u + ơ -> ư + ơ
-            if ((b1 == BASE_U) && (b2 == BASE_OW)) {
-                uint32_t old = word->chars[prev];
-                word->chars[prev] = get_vowel(BASE_UW, u1, t1);
-                record_transform(word, TRANS_MARK, prev, old, word->chars[prev], 'w');
-                normalize_tone_position(word);
-                return true;
-            }
-
-            // ươ + w -> undo back to uo
-            if ((b1 == BASE_UW) && (b2 == BASE_OW)) {
-                uint32_t old1 = word->chars[prev];
-                uint32_t old2 = word->chars[last];
-                word->chars[prev] = get_vowel(BASE_U, u1, t1);
-                word->chars[last] = get_vowel(BASE_O, u2, t2);
-                record_transform(word, TRANS_UNDO, prev, old1, word->chars[prev], 'w');
-                record_transform(word, TRANS_UNDO, last, old2, word->chars[last], 'w');
-                normalize_tone_position(word);
-                return true;
-            }
-        }
-    }
+    // UOW shortcut on the last two chars
+    if (word->len >= 2 && apply_uow(word, word->len - 2, word->len - 1, 'w')) return true;
 
     // Standard w handling: toggle ă/ư/ơ on single vowels
     for (int i = word->len - 1; i >= 0; i--) {
-        int row = find_vowel_row(word->chars[i]);
-        if (row < 0) continue;
-
-        int base = get_base_type(row);
-        bool upper = is_upper_row(row);
-        int tone = get_tone(word->chars[i]);
-        int new_base = -1;
-
-        if (base == BASE_A) new_base = BASE_AW;
-        else if (base == BASE_AW) new_base = BASE_A;
-        else if (base == BASE_O) new_base = BASE_OW;
-        else if (base == BASE_OW) new_base = BASE_O;
-        else if (base == BASE_U) new_base = BASE_UW;
-        else if (base == BASE_UW) new_base = BASE_U;
-
-        if (new_base >= 0) {
+        uint8_t v = vowel_info(word->chars[i]);
+        if (v == VOWEL_NONE) continue;
+
+        int new_base = horn_table[BASE_INDEX(VI_BASE(v))];
+        if (new_base != BASE_NONE) {
             uint32_t old = word->chars[i];
-            word->chars[i] = get_vowel(new_base, upper, tone);
+            word->chars[i] = get_vowel(new_base * 2, VI_UPPER(v), VI_TONE(v));
             record_transform(word, TRANS_MARK, i, old, word->chars[i], 'w');
             normalize_tone_position(word);
             return true;
@@ -594,30 +534,17 @@ static bool handle_w(Word *word) {
     return false;
 }
 
-// Handle aa, ee, oo
-static bool handle_double_vowel(Word *word, char key) {
+// Handle aa, ee, oo (key_base: base index of the typed vowel)
+static bool handle_double_vowel(Word *word, char key, int key_base) {
     if (word->len == 0) return false;
 
-    uint32_t last = word->chars[word->len - 1];
-    int row = find_vowel_row(last);
-    if (row < 0) return false;
-
-    int base = get_base_type(row);
-    bool upper = is_upper_row(row);
-    int tone = get_tone(last);
-    char k = tolower(key);
-    int new_base = -1;
-
-    if (k == 'a' && base == BASE_A) new_base = BASE_AA;
-    else if (k == 'a' && base == BASE_AA) new_base = BASE_A;
-    else if (k == 'e' && base == BASE_E) new_base = BASE_EE;
-    else if (k == 'e' && base == BASE_EE) new_base = BASE_E;
-    else if (k == 'o' && base == BASE_O) new_base = BASE_OO;
-    else if (k == 'o' && base == BASE_OO) new_base = BASE_O;
+    uint8_t v = vowel_info(word->chars[word->len - 1]);
+    if (v == VOWEL_NONE) return false;
 
-    if (new_base >= 0) {
+    int new_base = double_table[key_base * BASE_COUNT + BASE_INDEX(VI_BASE(v))];
+    if (new_base != BASE_NONE) {
         uint32_t old = word->chars[word->len - 1];
-        word->chars[word->len - 1] = get_vowel(new_base, upper, tone);
+        word->chars[word->len - 1] = get_vowel(new_base * 2, VI_UPPER(v), VI_TONE(v));
         record_transform(word, TRANS_MARK, word->len - 1, old, word->chars[word->len - 1], key);
         normalize_tone_position(word);
         return true;
@@ -625,9 +552,40 @@ static bool handle_double_vowel(Word *word, char key) {
     return false;
 }
 
-// Handle d -> đ
-static bool handle_d(Word *word) {
+// VNI/VIQR mark key: the mark goes on the last vowel taking it, a horn
+// on a u/o pair anywhere in the cluster makes ươ (người), the u of qu
+// excepted. Returns 2 when the key took its own mark off (the key char is
+// typed then, like a double tone press)
+static int handle_mark(Word *word, int mark, char key) {
+    if (mark == MARK_HORN && word->vo_start != NO_POS) {
+        int first = word->vo_start;
+        if (first == 1 && (word->chars[0] | 0x20) == 'q') first++;
+        for (int i = word->vo_end - 2; i >= first; i--) {
+            int result = apply_uow(word, i, i + 1, key);
+            if (result) return result;
+        }
+    }
+
     for (int i = word->len - 1; i >= 0; i--) {
+        uint8_t v = vowel_info(word->chars[i]);
+        if (v == VOWEL_NONE) continue;
+
+        uint8_t to = mark_table[mark * BASE_COUNT + BASE_INDEX(VI_BASE(v))];
+        if (to == BASE_NONE) continue;
+        bool undo = (to & MARK_UNDO) != 0;
+        uint32_t old = word->chars[i];
+        word->chars[i] = get_vowel((to & ~MARK_UNDO) * 2, VI_UPPER(v), VI_TONE(v));
+        record_transform(word, undo ? TRANS_UNDO : TRANS_MARK, i, old, word->chars[i], key);
+        normalize_tone_position(word);
+        return undo ? 2 : 1;
+    }
+    return 0;
+}
+
+// Handle d -> đ (last_only: only a d right before the key, VIQR dd)
+static bool handle_d(Word *word, bool last_only) {
+    int stop = last_only ? word->len - 1 : 0;
+    for (int i = word->len - 1; i >= stop && i >= 0; i--) {
         uint32_t ch = word->chars[i];
         uint32_t new_ch = 0;
 
@@ -637,8 +595,8 @@ static bool handle_d(Word *word) {
         else if (ch == 0x0110) new_ch = 'D';
 
         if (new_ch) {
-            record_transform(word, TRANS_D_STROKE, i, ch, new_ch, 'd');
             word->chars[i] = new_ch;
+            record_transform(word, TRANS_D_STROKE, i, ch, new_ch, 'd');
             return true;
         }
     }
@@ -649,64 +607,60 @@ static bool handle_d(Word *word) {
 // MAIN PROCESS FUNCTION
 // ============================================================================
 
+_Static_assert(sizeof(key_actions) / sizeof(key_actions[0]) == METHOD_COUNT,
+               "key_actions has one row per InputMethod");
+
 // Returns: 0 = no change, 1 = transformed, 2 = undo (double press, add key char)
-int telex_process(Word *word, char key) {
+static inline int process(Word *word, InputMethod method, char key) {
     if (word->len >= MAX_WORD_LEN - 1) return 0;
 
-    char k = tolower(key);
-    int result;
-    int tone_for_key = 0;
-
-    // Map key to tone
-    switch (k) {
-        case 's': tone_for_key = 1; break;
-        case 'f': tone_for_key = 2; break;
-        case 'r': tone_for_key = 3; break;
-        case 'x': tone_for_key = 4; break;
-        case 'j': tone_for_key = 5; break;
-    }
-
-    // If this tone was previously cancelled, don't apply it again - just add the char
-    if (tone_for_key > 0 && word->cancelled_tone == tone_for_key) {
-        return 0;  // Signal: no transformation, keyboard.c will add char normally
+    unsigned char k = (unsigned char)key;
+    uint8_t action = k < 128 ? key_actions[method][k] : ACT_NONE;
+    int arg = ACT_ARG(action);
+
+    switch (ACT_KIND(action)) {
+        case ACT_TONE: {
+            // If this tone was previously cancelled, don't apply it again - just add the char
+            if (arg > 0 && word->cancelled_tone == arg) return 0;
+
+            // Freedom typing: apply to correct position automatically
+            int result = apply_tone_ex(word, arg, key);
+            if (result == 2) {
+                // Double press: mark this tone as cancelled
+                word->cancelled_tone = arg;
+                return 2;
+            } else if (result == 1) {
+                // Tone applied: clear any previous cancellation
+                word->cancelled_tone = 0;
+                return 1;
+            }
+            return 0;
+        }
+        case ACT_DOUBLE:
+            return handle_double_vowel(word, key, arg) ? 1 : 0;
+        case ACT_HORN:
+            return handle_w(word) ? 1 : 0;
+        case ACT_STROKE:
+            return handle_d(word, arg != 0) ? 1 : 0;
+        case ACT_MARK:
+            return handle_mark(word, arg, key);
     }
 
-    // Tone marks (freedom typing: apply to correct position automatically)
-    switch (k) {
-        case 's': result = apply_tone_ex(word, 1, key); break;
-        case 'f': result = apply_tone_ex(word, 2, key); break;
-        case 'r': result = apply_tone_ex(word, 3, key); break;
-        case 'x': result = apply_tone_ex(word, 4, key); break;
-        case 'j': result = apply_tone_ex(word, 5, key); break;
-        case 'z': result = apply_tone_ex(word, 0, key); break;
-        default: result = 0; break;
-    }
+    // No transformation happened
+    return 0;
+}
 
-    if (result == 2) {
-        // Double press: mark this tone as cancelled
-        word->cancelled_tone = tone_for_key;
-        return 2;
-    } else if (result == 1) {
-        // Tone applied: clear any previous cancellation
-        word->cancelled_tone = 0;
-        return 1;
-    }
+int telex_process(Word *word, char key) {
+    return process(word, METHOD_TELEX, key);
+}
 
-    // Vowel modifications
-    switch (k) {
-        case 'a': case 'e': case 'o':
-            if (handle_double_vowel(word, key)) return 1;
-            break;
-        case 'w':
-            if (handle_w(word)) return 1;
-            break;
-        case 'd':
-            if (handle_d(word)) return 1;
-            break;
-    }
+int telex_process_method(Word *word, InputMethod method, char key) {
+    return process(word, method, key);
+}
 
-    // No transformation happened
-    return 0;
+bool telex_is_method_key(InputMethod method, char key) {
+    unsigned char k = (unsigned char)key;
+    return k < 128 && key_actions[method][k] != ACT_NONE;
 }
 
 // ============================================================================
@@ -722,25 +676,81 @@ bool telex_is_vowel(uint32_t ch) {
 }
 
 int word_to_utf8(const Word *word, char *buf, int buf_size) {
+    return word_tail_to_utf8(word, 0, buf, buf_size);
+}
+
+// Write one BMP codepoint as UTF-8, returns bytes written
+static inline int utf8_put(char *buf, uint32_t cp) {
+    if (cp < 0x80) {
+        buf[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        buf[0] = (char)(0xC0 | (cp >> 6));
+        buf[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    buf[0] = (char)(0xE0 | (cp >> 12));
+    buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    buf[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+}
+
+int word_tail_to_utf8(const Word *word, int start, char *buf, int buf_size) {
     int pos = 0;
-    for (int i = 0; i < word->len && pos < buf_size - 4; i++) {
-        uint32_t cp = word->chars[i];
-        if (cp < 0x80) {
-            buf[pos++] = (char)cp;
-        } else if (cp < 0x800) {
-            buf[pos++] = (char)(0xC0 | (cp >> 6));
-            buf[pos++] = (char)(0x80 | (cp & 0x3F));
-        } else if (cp < 0x10000) {
-            buf[pos++] = (char)(0xE0 | (cp >> 12));
-            buf[pos++] = (char)(0x80 | ((cp >> 6) & 0x3F));
-            buf[pos++] = (char)(0x80 | (cp & 0x3F));
-        } else {
-            buf[pos++] = (char)(0xF0 | (cp >> 18));
-            buf[pos++] = (char)(0x80 | ((cp >> 12) & 0x3F));
-            buf[pos++] = (char)(0x80 | ((cp >> 6) & 0x3F));
-            buf[pos++] = (char)(0x80 | (cp & 0x3F));
+    for (int i = start; i < word->len && pos < buf_size - 4; i++) {
+        pos += utf8_put(buf + pos, word->chars[i]);
+    }
+    buf[pos] = '\0';
+    return pos;
+}
+
+// ============================================================================
+// OUTPUT ENCODINGS
+// ============================================================================
+
+// Vowels and đ come from the tables, NULL for anything else (the same in
+// every encoding)
+static inline const EncodedChar *encoded_char(uint32_t ch, TextEncoding enc) {
+    uint8_t v = vowel_info(ch);
+    if (v != VOWEL_NONE) return &enc_vowels[enc][VI_ROW(v) * 6 + VI_TONE(v)];
+    if ((ch | 1) == 0x0111) return &enc_dd[enc][ch == 0x0110];
+    return NULL;
+}
+
+int word_tail_encode(const Word *word, int start, TextEncoding enc, char *buf, int buf_size) {
+    int pos = 0;
+    for (int i = start; i < word->len && pos < buf_size - ENC_MAX_BYTES; i++) {
+        const EncodedChar *e = encoded_char(word->chars[i], enc);
+        if (!e) {
+            pos += utf8_put(buf + pos, word->chars[i]);
+            continue;
         }
+        memcpy(buf + pos, e->utf8, ENC_MAX_BYTES);
+        pos += e->len;
     }
     buf[pos] = '\0';
     return pos;
 }
+
+int telex_encoded_units(uint32_t ch, TextEncoding enc) {
+    const EncodedChar *e = encoded_char(ch, enc);
+    return e ? e->units : 1;
+}
+
+int telex_changed_units(const Word *word, TelexCheckpoint cp, int start, int old_len,
+                        TextEncoding enc) {
+    if (enc_max_units[enc] == 1) return old_len - start;
+
+    int units = 0;
+    int n = records_since(word, cp);
+    for (int i = start; i < old_len; i++) {
+        // The oldest record at i holds the character before the key
+        uint32_t ch = word->chars[i];
+        for (int h = n - 1; h >= 0; h--) {
+            const Transformation *t = &word->history[(uint8_t)(cp.history_len + h) & (MAX_HISTORY - 1)];
+            if (t->target_pos == i) ch = t->old_char;
+        }
+        units += telex_encoded_units(ch, enc);
+    }
+    return units;
+}
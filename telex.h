@@ -4,8 +4,32 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define MAX_WORD_LEN 32
-#define MAX_HISTORY 64
+#define MAX_WORD_LEN 29     // Header + chars fill one 64-byte cache line
+#define NO_POS 0xFF         // Unset position in Word structure fields
+#define MAX_HISTORY 8       // Ring; one key records at most 4 transformations
+
+// Input methods: which keys add tones, vowel marks and đ. Each one is a
+// key -> action table (gen_tables.c) run by the same engine
+typedef enum {
+    METHOD_TELEX,       // s f r x j z, aa ee oo, w, dd
+    METHOD_VNI,         // 1-5 tones, 0 removes, 6 ^, 7 horn, 8 breve, 9 đ
+    METHOD_VIQR,        // ' ` ? ~ . tones, ^ + ( marks, dd
+    METHOD_COUNT
+} InputMethod;
+
+// Output encodings of the edit text. Every encoding comes out as UTF-8;
+// legacy 8-bit charsets as the Latin-1 codepoints of their bytes, which is
+// what their fonts draw
+typedef enum {
+    ENC_UNICODE,        // Precomposed (NFC)
+    ENC_NFD,            // Base letter + combining marks
+    ENC_TCVN3,          // TCVN 5712 VN3 (ABC), .Vn fonts
+    ENC_VNI_WIN,        // VNI-Windows: letter + mark byte
+    ENC_VISCII,
+    ENC_COUNT
+} TextEncoding;
+
+#define ENC_MAX_BYTES 6     // UTF-8 bytes written per character, padding included
 
 // Transformation types for history tracking
 typedef enum {
@@ -16,26 +40,42 @@ typedef enum {
     TRANS_UNDO          // Undid a transformation
 } TransformType;
 
-// Single transformation record
+// Single transformation record (Vietnamese letters are all in the BMP)
 typedef struct {
-    TransformType type;
-    int target_pos;     // Position affected
-    uint32_t old_char;  // Character before transformation
-    uint32_t new_char;  // Character after transformation
+    uint8_t type;       // TransformType
+    uint8_t target_pos; // Position affected
     char key;           // Key that triggered this
+    uint16_t old_char;  // Character before transformation
+    uint16_t new_char;  // Character after transformation
 } Transformation;
 
-// Word with transformation history
+// Word with transformation history: first cache line is the header and
+// the text, the second one the history ring.
+// Syllable structure is kept up to date by telex_append()/telex_backspace()
+// and every transformation: chars[0, vo_start) first consonant,
+// [vo_start, vo_end) first vowel cluster, [vo_end, len) last consonant.
+// Writing chars[] directly bypasses it.
 typedef struct {
-    uint32_t chars[MAX_WORD_LEN];  // UTF-32 codepoints
-    int len;
-    int cancelled_tone;  // Tone that was cancelled (1-5), 0 = none
-
-    // Transformation history for smart undo
+    _Alignas(64) uint8_t len;
+    uint8_t cancelled_tone;  // Tone that was cancelled (1-5), 0 = none
+    uint8_t history_len;     // Records ever written (wraps), newest at
+                             // history[(history_len - 1) % MAX_HISTORY]
+    uint8_t vo_start;        // First vowel, NO_POS if none yet
+    uint8_t vo_end;          // One past the first vowel cluster
+    uint8_t tone_at;         // First char carrying a tone, NO_POS if none
+    uint16_t chars[MAX_WORD_LEN];  // BMP codepoints
+
+    // Transformation history for smart undo and rollback
     Transformation history[MAX_HISTORY];
-    int history_len;
 } Word;
 
+// State before a key, to undo what telex_process() did with it
+typedef struct {
+    uint8_t len;
+    uint8_t cancelled_tone;
+    uint8_t history_len;
+} TelexCheckpoint;
+
 // CVC (Consonant-Vowel-Consonant) info for spell checking
 typedef struct {
     int fc_start, fc_end;   // First consonant range (inclusive)
@@ -51,9 +91,30 @@ void telex_init(void);
 // Returns: 0 = no change, 1 = transformed, 2 = undo (double press, add key char)
 int telex_process(Word *word, char key);
 
+// Same with any input method (telex_process() is METHOD_TELEX)
+int telex_process_method(Word *word, InputMethod method, char key);
+
+// Check if a key can transform the word in this input method
+bool telex_is_method_key(InputMethod method, char key);
+
 // Reset current word
 void telex_reset(Word *word);
 
+// Add a typed character (false when the word is full)
+bool telex_append(Word *word, uint32_t ch);
+
+// Remove the last character
+void telex_backspace(Word *word);
+
+// Remember the word state before a key (three bytes, no copy of the word)
+TelexCheckpoint telex_checkpoint(const Word *word);
+
+// Undo every transformation recorded since the checkpoint
+void telex_rollback(Word *word, TelexCheckpoint cp);
+
+// First position changed since the checkpoint (cp.len if only appended to)
+int telex_changed_from(const Word *word, TelexCheckpoint cp);
+
 // Normalize tone position after adding a vowel
 void telex_normalize_tone(Word *word);
 
@@ -72,4 +133,19 @@ bool telex_is_valid_tone(const Word *word, int tone);
 // Convert UTF-32 word to UTF-8 string
 int word_to_utf8(const Word *word, char *buf, int buf_size);
 
+// Convert chars[start..len) to UTF-8 (changed tail of a word)
+int word_tail_to_utf8(const Word *word, int start, char *buf, int buf_size);
+
+// Convert chars[start..len) to an output encoding; buf holds
+// ENC_MAX_BYTES per character plus one
+int word_tail_encode(const Word *word, int start, TextEncoding enc, char *buf, int buf_size);
+
+// Characters (codepoints) one word character takes in the text field
+int telex_encoded_units(uint32_t ch, TextEncoding enc);
+
+// Characters chars[start..old_len) took in the text field before the
+// changes since the checkpoint (the backspaces to retype them)
+int telex_changed_units(const Word *word, TelexCheckpoint cp, int start, int old_len,
+                        TextEncoding enc);
+
 #endif
@@ -0,0 +1,110 @@
+#ifndef TELEX_DATA_H
+#define TELEX_DATA_H
+
+#include <stdint.h>
+#include "telex.h"
+
+// Vietnamese vowels with tones
+// Rows: base vowel variants, Columns: tones (0=none, 1=sắc, 2=huyền, 3=hỏi, 4=ngã, 5=nặng)
+static const uint32_t vowel_table[][6] = {
+    {'a', 0x00E1, 0x00E0, 0x1EA3, 0x00E3, 0x1EA1},  // 0: a
+    {'A', 0x00C1, 0x00C0, 0x1EA2, 0x00C3, 0x1EA0},  // 1: A
+    {0x0103, 0x1EAF, 0x1EB1, 0x1EB3, 0x1EB5, 0x1EB7},  // 2: ă
+    {0x0102, 0x1EAE, 0x1EB0, 0x1EB2, 0x1EB4, 0x1EB6},  // 3: Ă
+    {0x00E2, 0x1EA5, 0x1EA7, 0x1EA9, 0x1EAB, 0x1EAD},  // 4: â
+    {0x00C2, 0x1EA4, 0x1EA6, 0x1EA8, 0x1EAA, 0x1EAC},  // 5: Â
+    {'e', 0x00E9, 0x00E8, 0x1EBB, 0x1EBD, 0x1EB9},  // 6: e
+    {'E', 0x00C9, 0x00C8, 0x1EBA, 0x1EBC, 0x1EB8},  // 7: E
+    {0x00EA, 0x1EBF, 0x1EC1, 0x1EC3, 0x1EC5, 0x1EC7},  // 8: ê
+    {0x00CA, 0x1EBE, 0x1EC0, 0x1EC2, 0x1EC4, 0x1EC6},  // 9: Ê
+    {'i', 0x00ED, 0x00EC, 0x1EC9, 0x0129, 0x1ECB},  // 10: i
+    {'I', 0x00CD, 0x00CC, 0x1EC8, 0x0128, 0x1ECA},  // 11: I
+    {'o', 0x00F3, 0x00F2, 0x1ECF, 0x00F5, 0x1ECD},  // 12: o
+    {'O', 0x00D3, 0x00D2, 0x1ECE, 0x00D5, 0x1ECC},  // 13: O
+    {0x00F4, 0x1ED1, 0x1ED3, 0x1ED5, 0x1ED7, 0x1ED9},  // 14: ô
+    {0x00D4, 0x1ED0, 0x1ED2, 0x1ED4, 0x1ED6, 0x1ED8},  // 15: Ô
+    {0x01A1, 0x1EDB, 0x1EDD, 0x1EDF, 0x1EE1, 0x1EE3},  // 16: ơ
+    {0x01A0, 0x1EDA, 0x1EDC, 0x1EDE, 0x1EE0, 0x1EE2},  // 17: Ơ
+    {'u', 0x00FA, 0x00F9, 0x1EE7, 0x0169, 0x1EE5},  // 18: u
+    {'U', 0x00DA, 0x00D9, 0x1EE6, 0x0168, 0x1EE4},  // 19: U
+    {0x01B0, 0x1EE9, 0x1EEB, 0x1EED, 0x1EEF, 0x1EF1},  // 20: ư
+    {0x01AF, 0x1EE8, 0x1EEA, 0x1EEC, 0x1EEE, 0x1EF0},  // 21: Ư
+    {'y', 0x00FD, 0x1EF3, 0x1EF7, 0x1EF9, 0x1EF5},  // 22: y
+    {'Y', 0x00DD, 0x1EF2, 0x1EF6, 0x1EF8, 0x1EF4},  // 23: Y
+};
+
+#define VOWEL_ROWS 24
+#define BASE_A  0
+#define BASE_AW 2
+#define BASE_AA 4
+#define BASE_E  6
+#define BASE_EE 8
+#define BASE_I  10
+#define BASE_O  12
+#define BASE_OO 14
+#define BASE_OW 16
+#define BASE_U  18
+#define BASE_UW 20
+#define BASE_Y  22
+
+// Packed vowel index entry (see gen_tables.c): bits 7..3 = row, bits 2..0 = tone.
+// Row bit 0 is the case, so base and case come out of the same byte.
+#define VOWEL_NONE  0xFF
+#define VI_PACK(row, tone) ((uint8_t)(((row) << 3) | (tone)))
+#define VI_ROW(v)   ((int)((v) >> 3))
+#define VI_BASE(v)  ((int)(((v) >> 3) & ~1))
+#define VI_UPPER(v) (((v) >> 3) & 1)
+#define VI_TONE(v)  ((int)((v) & 7))
+
+// Index ranges: U+0000..U+01BF (ASCII, Latin-1, Latin Extended-A/B)
+// and U+1EA0..U+1EF9 (Latin Extended Additional)
+#define VOWEL_INDEX_LO_END   0x01C0
+#define VOWEL_INDEX_HI_START 0x1EA0
+#define VOWEL_INDEX_HI_END   0x1EFA
+
+// Base vowel index (row / 2): 0=a 1=ă 2=â 3=e 4=ê 5=i 6=o 7=ô 8=ơ 9=u 10=ư 11=y
+#define BASE_COUNT  12
+#define BASE_INDEX(base_row) ((base_row) >> 1)
+#define BASE_NONE   0xFF
+
+// Vowel nucleus id for clusters of 1..3 vowels (tone_pos_table index)
+#define NUCLEUS_MAX_LEN 3
+#define NUCLEUS_ID1(b1)         (b1)
+#define NUCLEUS_ID2(b1, b2)     (BASE_COUNT + (b1) * BASE_COUNT + (b2))
+#define NUCLEUS_ID3(b1, b2, b3) (BASE_COUNT + BASE_COUNT * BASE_COUNT + \
+                                 ((b1) * BASE_COUNT + (b2)) * BASE_COUNT + (b3))
+#define NUCLEUS_COUNT           NUCLEUS_ID3(BASE_COUNT, 0, 0)
+
+// Key actions (key_actions table): kind in bits 7..4, argument in bits 3..0
+#define ACT_NONE    0x00
+#define ACT_TONE    0x10    // arg = tone (0 = remove)
+#define ACT_DOUBLE  0x20    // arg = base index of the doubled vowel (aa, ee, oo)
+#define ACT_HORN    0x30    // Telex w: ă, ơ, ư
+#define ACT_STROKE  0x40    // d: đ; arg 1 = only the last char (VIQR dd)
+#define ACT_MARK    0x50    // arg = MARK_*, on the last vowel taking it
+#define ACT_KIND(a) ((a) & 0xF0)
+#define ACT_ARG(a)  ((a) & 0x0F)
+
+// Vowel marks of ACT_MARK (mark_table): base -> new base, MARK_UNDO when
+// the key takes its own mark off again
+#define MARK_HAT    0       // â ê ô
+#define MARK_BREVE  1       // ă
+#define MARK_HORN   2       // ơ ư, uo -> ươ
+#define MARK_COUNT  3
+#define MARK_UNDO   0x80
+
+// One character in an output encoding (enc_vowels, enc_dd): UTF-8 padded
+// to ENC_MAX_BYTES so it is copied whole, and the codepoints it makes
+typedef struct {
+    char utf8[ENC_MAX_BYTES];
+    uint8_t len;
+    uint8_t units;
+} EncodedChar;
+
+// UOW pair transitions (uow_table): new bases of the last two vowels
+#define UOW_VALID   0x8000
+#define UOW_UNDO    0x4000
+#define UOW_B1(t)   (((t) >> 4) & 0x0F)
+#define UOW_B2(t)   ((t) & 0x0F)
+
+#endif
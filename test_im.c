@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#include "im.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Input method backend test: a stand-in compositor listens on
+// $XDG_RUNTIME_DIR/wayland-test (a private temporary directory), answers
+// the handshake im_open() makes, then sends activate/deactivate/done
+// events and checks every request each edit produces: the byte count of
+// delete_surrounding_text, the commit_string payload and the commit serial
+
+#define DISPLAY_ID 1
+#define DISPLAY_SYNC            0
+#define DISPLAY_GET_REGISTRY    1
+#define REGISTRY_BIND           0
+#define REGISTRY_GLOBAL         0
+#define CALLBACK_DONE           0
+#define MANAGER_GET_INPUT_METHOD 0
+#define IM_COMMIT_STRING        0
+#define IM_DELETE_SURROUNDING   2
+#define IM_COMMIT               3
+#define IM_DESTROY              6
+#define IM_ACTIVATE             0
+#define IM_DEACTIVATE           1
+#define IM_DONE                 5
+#define IM_UNAVAILABLE          6
+
+#define SEAT_NAME    1
+#define MANAGER_NAME 2
+
+static int checks = 0, failed = 0;
+static const char *step = "";
+
+#define CHECK(cond, ...) do {                                   \
+    checks++;                                                   \
+    if (!(cond)) {                                              \
+        failed++;                                               \
+        fprintf(stderr, "FAIL [%s] line %d: ", step, __LINE__); \
+        fprintf(stderr, __VA_ARGS__);                           \
+        fputc('\n', stderr);                                    \
+    }                                                           \
+} while (0)
+
+// ============================================================================
+// STAND-IN COMPOSITOR
+// ============================================================================
+
+typedef struct {
+    uint32_t id, opcode;
+    uint32_t size;              // Body bytes
+    uint32_t body[256];
+} Request;
+
+static struct {
+    int listen_fd;
+    int fd;                     // Connection to im.c
+    bool busy;                  // Another input method holds the seat
+    uint32_t registry, manager, im;
+    uint32_t serial;            // done events sent
+} server = { .listen_fd = -1, .fd = -1 };
+
+static uint32_t buf[256];
+static int buf_len = 0;
+
+static void put_uint(uint32_t v) {
+    buf[buf_len++] = v;
+}
+
+static void put_string(const char *s) {
+    uint32_t n = (uint32_t)strlen(s) + 1;
+    buf[buf_len++] = n;
+    memset(&buf[buf_len], 0, (n + 3) & ~3u);
+    memcpy(&buf[buf_len], s, n);
+    buf_len += (int)((n + 3) / 4);
+}
+
+static void event_begin(uint32_t id, uint32_t opcode) {
+    buf_len = 0;
+    put_uint(id);
+    put_uint(opcode);
+}
+
+// A client that gave up (seat taken) may already have hung up
+static void event_send(void) {
+    buf[1] |= (uint32_t)buf_len * 4 << 16;
+    if (send(server.fd, buf, (size_t)buf_len * 4, MSG_NOSIGNAL) < 0 && errno != EPIPE)
+        perror("server send");
+}
+
+// Next request from the client: 1, 0 on timeout, -1 on hang-up
+static int read_request(Request *r, int timeout_ms) {
+    struct pollfd pfd = { .fd = server.fd, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+    uint32_t hdr[2];
+    if (recv(server.fd, hdr, 8, MSG_WAITALL) != 8) return -1;
+    r->id = hdr[0];
+    r->opcode = hdr[1] & 0xFFFF;
+    r->size = (hdr[1] >> 16) - 8;
+    if ((hdr[1] >> 16) < 8 || r->size > sizeof(r->body) || (r->size & 3)) return -1;
+    if (r->size > 0 && recv(server.fd, r->body, r->size, MSG_WAITALL) != (ssize_t)r->size) return -1;
+    return 1;
+}
+
+// Words taken by the string argument at word index i, 0 if malformed
+static uint32_t string_words(const Request *r, uint32_t i) {
+    if ((i + 1) * 4 > r->size) return 0;
+    uint32_t n = r->body[i];
+    uint32_t words = 1 + (n + 3) / 4;
+    if (n == 0 || (i + words) * 4 > r->size) return 0;
+    if (((const char *)&r->body[i + 1])[n - 1] != '\0') return 0;
+    return words;
+}
+
+// Registry, binds and the input method: everything im_open() waits for,
+// i.e. its two roundtrips
+static void *server_handshake(void *arg) {
+    (void)arg;
+    server.fd = accept(server.listen_fd, NULL, NULL);
+    if (server.fd < 0) {
+        perror("accept");
+        return NULL;
+    }
+    Request r;
+    int syncs = 0;
+    while (syncs < 2 && read_request(&r, 1000) > 0) {
+        if (r.id == DISPLAY_ID && r.opcode == DISPLAY_GET_REGISTRY) {
+            server.registry = r.body[0];
+            event_begin(server.registry, REGISTRY_GLOBAL);
+            put_uint(SEAT_NAME);
+            put_string("wl_seat");
+            put_uint(7);
+            event_send();
+            event_begin(server.registry, REGISTRY_GLOBAL);
+            put_uint(MANAGER_NAME);
+            put_string("zwp_input_method_manager_v2");
+            put_uint(1);
+            event_send();
+        } else if (r.id == DISPLAY_ID && r.opcode == DISPLAY_SYNC) {
+            event_begin(r.body[0], CALLBACK_DONE);
+            put_uint(0);
+            event_send();
+            syncs++;
+        } else if (r.id == server.registry && r.opcode == REGISTRY_BIND) {
+            uint32_t words = string_words(&r, 1);
+            if (words && r.body[0] == MANAGER_NAME) server.manager = r.body[1 + words + 1];
+        } else if (r.id == server.manager && r.opcode == MANAGER_GET_INPUT_METHOD) {
+            server.im = r.body[1];
+            if (server.busy) {
+                event_begin(server.im, IM_UNAVAILABLE);
+                event_send();
+            }
+        }
+    }
+    return NULL;
+}
+
+static int server_open(bool busy) {
+    server.busy = busy;
+    server.registry = server.manager = server.im = 0;
+    server.serial = 0;
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_handshake, NULL);
+    int rc = im_open();
+    pthread_join(thread, NULL);
+    return rc;
+}
+
+static void server_close(void) {
+    if (server.fd >= 0) close(server.fd);
+    server.fd = -1;
+}
+
+static void send_state(bool active) {
+    event_begin(server.im, active ? IM_ACTIVATE : IM_DEACTIVATE);
+    event_send();
+    event_begin(server.im, IM_DONE);
+    event_send();
+    server.serial++;
+}
+
+// ============================================================================
+// EXPECTATIONS
+// ============================================================================
+
+static bool next_request(Request *r) {
+    int rc = read_request(r, 1000);
+    CHECK(rc > 0, "no request from the client");
+    if (rc <= 0) return false;
+    CHECK(r->id == server.im, "request on object %u, not the input method %u", r->id, server.im);
+    return r->id == server.im;
+}
+
+static void expect_delete(uint32_t bytes) {
+    Request r;
+    if (!next_request(&r)) return;
+    CHECK(r.opcode == IM_DELETE_SURROUNDING, "opcode %u, expected delete_surrounding_text", r.opcode);
+    CHECK(r.size == 8, "delete_surrounding_text of %u bytes", r.size);
+    if (r.opcode != IM_DELETE_SURROUNDING || r.size != 8) return;
+    CHECK(r.body[0] == bytes, "deleted %u bytes before the cursor, expected %u", r.body[0], bytes);
+    CHECK(r.body[1] == 0, "deleted %u bytes after the cursor", r.body[1]);
+}
+
+static void expect_string(const char *text) {
+    Request r;
+    if (!next_request(&r)) return;
+    CHECK(r.opcode == IM_COMMIT_STRING, "opcode %u, expected commit_string", r.opcode);
+    if (r.opcode != IM_COMMIT_STRING) return;
+    uint32_t words = string_words(&r, 0);
+    CHECK(words > 0 && words * 4 == r.size, "malformed commit_string (%u bytes)", r.size);
+    if (words == 0) return;
+    const char *got = (const char *)&r.body[1];
+    CHECK(strcmp(got, text) == 0, "committed \"%s\", expected \"%s\"", got, text);
+}
+
+static void expect_commit(uint32_t serial) {
+    Request r;
+    if (!next_request(&r)) return;
+    CHECK(r.opcode == IM_COMMIT, "opcode %u, expected commit", r.opcode);
+    if (r.opcode != IM_COMMIT) return;
+    CHECK(r.size == 4 && r.body[0] == serial, "commit serial %u, expected %u", r.body[0], serial);
+}
+
+static void expect_nothing(void) {
+    Request r;
+    int rc = read_request(&r, 50);
+    CHECK(rc == 0, "unexpected request (object %u, opcode %u)", r.id, r.opcode);
+}
+
+// One edit: delete_surrounding_text (if any bytes), commit_string (if any
+// text), then commit with the current serial
+static void edit(const char *name, int bs_count, const char *text, uint32_t bytes) {
+    step = name;
+    im_replace(bs_count, text);
+    if (bytes > 0) expect_delete(bytes);
+    if (*text) expect_string(text);
+    expect_commit(server.serial);
+    expect_nothing();
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(void) {
+    char dir[] = "/tmp/unikey-test-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/wayland-test", dir);
+    setenv("XDG_RUNTIME_DIR", dir, 1);
+    setenv("WAYLAND_DISPLAY", "wayland-test", 1);
+
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server.listen_fd < 0 ||
+        bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(server.listen_fd, 1) < 0) {
+        perror(addr.sun_path);
+        rmdir(dir);
+        return 1;
+    }
+
+    step = "seat taken";
+    CHECK(server_open(true) < 0, "im_open succeeded with another input method running");
+    server_close();
+
+    step = "open";
+    CHECK(server_open(false) == 0, "im_open failed");
+    CHECK(server.im != 0, "no get_input_method request");
+
+    step = "inactive";
+    im_replace(0, "a");
+    expect_nothing();
+
+    send_state(true);
+    edit("type a", 0, "a", 0);
+    edit("tone on ASCII", 1, "á", 1);
+    edit("2-byte to 3-byte", 1, "ấ", 2);
+    edit("unchanged tail", 0, "n", 0);
+    edit("delete only", 1, "", 1);
+
+    // Keys that reached the text field without us: ASCII and accented
+    im_typed('t');
+    im_typed(0x01B0);           // ư
+    edit("typed keys", 3, "ươ", 1 + 2 + 3);
+    im_typed('k');
+    im_typed('\b');
+    edit("typed backspace", 1, "y", 2);
+    im_typed(0);                // Cursor moved: nothing known, ASCII assumed
+    edit("cursor moved", 2, "z", 2);
+
+    // Beyond what the shadow remembers, characters count as ASCII
+    edit("unknown text", 3, "đ", 1 + 1 + 1);
+
+    // What output_typed() passes on, with or without the output thread:
+    // the app's own "a" after a committed "á" is one byte, not two
+    edit("commit before typed", 1, "á", 2);
+    im_typed('a');
+    edit("backspace over typed", 1, "", 1);
+
+    step = "deactivated";
+    send_state(false);
+    im_replace(1, "b");
+    expect_nothing();
+
+    // Focus into a new field: the previous one's text is not counted
+    send_state(true);
+    edit("new field", 1, "c", 1);
+
+    // Focus from one field to another while active: activate again
+    edit("accented", 0, "ở", 0);
+    send_state(true);
+    edit("re-activated", 1, "", 1);
+    edit("serial", 0, "d", 0);
+
+    step = "close";
+    im_close();
+    Request r;
+    CHECK(read_request(&r, 1000) > 0 && r.id == server.im && r.opcode == IM_DESTROY,
+          "no destroy request");
+    CHECK(read_request(&r, 1000) < 0, "connection not closed");
+    server_close();
+
+    close(server.listen_fd);
+    unlink(addr.sun_path);
+    rmdir(dir);
+
+    printf("im: %d checks, %d failed\n", checks, failed);
+    return failed > 0;
+}
@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+#include "unikey.h"
+#include "telex.h"
+#include "conv.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct UnikeyEngine {
+    Word word;
+    bool vietnamese;
+    InputMethod method;
+    TextEncoding encoding;
+    char text[MAX_WORD_LEN * ENC_MAX_BYTES + 1];
+    UnikeyObserver observer;
+    void *observer_ctx;
+};
+
+_Static_assert((int)UNIKEY_TONE == TRANS_TONE && (int)UNIKEY_MARK == TRANS_MARK &&
+               (int)UNIKEY_D_STROKE == TRANS_D_STROKE && (int)UNIKEY_UNDO == TRANS_UNDO,
+               "UnikeyChangeType mirrors TransformType");
+_Static_assert((int)UNIKEY_TELEX == METHOD_TELEX && (int)UNIKEY_VNI == METHOD_VNI &&
+               (int)UNIKEY_VIQR == METHOD_VIQR && (int)UNIKEY_METHOD_COUNT == METHOD_COUNT,
+               "UnikeyMethod mirrors InputMethod");
+_Static_assert((int)UNIKEY_UNICODE == ENC_UNICODE && (int)UNIKEY_NFD == ENC_NFD &&
+               (int)UNIKEY_TCVN3 == ENC_TCVN3 && (int)UNIKEY_VNI_WIN == ENC_VNI_WIN &&
+               (int)UNIKEY_VISCII == ENC_VISCII && (int)UNIKEY_ENCODING_COUNT == ENC_COUNT,
+               "UnikeyEncoding mirrors TextEncoding");
+
+UnikeyEngine *unikey_new(void) {
+    // Word is cache-line aligned
+    UnikeyEngine *e = aligned_alloc(_Alignof(UnikeyEngine), sizeof(UnikeyEngine));
+    if (!e) return NULL;
+    memset(e, 0, sizeof(*e));
+    telex_reset(&e->word);
+    e->vietnamese = true;
+    return e;
+}
+
+void unikey_free(UnikeyEngine *engine) {
+    free(engine);
+}
+
+void unikey_reset(UnikeyEngine *engine) {
+    telex_reset(&engine->word);
+}
+
+void unikey_set_vietnamese(UnikeyEngine *engine, bool on) {
+    engine->vietnamese = on;
+    telex_reset(&engine->word);
+}
+
+bool unikey_is_vietnamese(const UnikeyEngine *engine) {
+    return engine->vietnamese;
+}
+
+void unikey_set_method(UnikeyEngine *engine, UnikeyMethod method) {
+    if ((unsigned)method >= METHOD_COUNT) return;
+    engine->method = (InputMethod)method;
+    telex_reset(&engine->word);
+}
+
+UnikeyMethod unikey_get_method(const UnikeyEngine *engine) {
+    return (UnikeyMethod)engine->method;
+}
+
+bool unikey_is_method_key(const UnikeyEngine *engine, char c) {
+    return telex_is_method_key(engine->method, c);
+}
+
+void unikey_set_encoding(UnikeyEngine *engine, UnikeyEncoding encoding) {
+    if ((unsigned)encoding >= ENC_COUNT) return;
+    engine->encoding = (TextEncoding)encoding;
+    telex_reset(&engine->word);
+}
+
+UnikeyEncoding unikey_get_encoding(const UnikeyEngine *engine) {
+    return (UnikeyEncoding)engine->encoding;
+}
+
+// Hand the decision for one key to the observer
+static void observe(UnikeyEngine *engine, char c, int result, const char *before,
+                    TelexCheckpoint cp) {
+    const Word *word = &engine->word;
+    char after[MAX_WORD_LEN * 4 + 1];
+    word_to_utf8(word, after, sizeof(after));
+
+    UnikeyStep step = { .key = c, .result = result, .before = before, .after = after };
+    int added = (uint8_t)(word->history_len - cp.history_len);
+    if (added > MAX_HISTORY) added = MAX_HISTORY;
+    for (int i = 0; i < added && step.n_changes < 4; i++) {
+        const Transformation *t = &word->history[(uint8_t)(cp.history_len + i) % MAX_HISTORY];
+        step.changes[step.n_changes++] = (UnikeyChange){
+            .type = t->type, .pos = t->target_pos, .from = t->old_char, .to = t->new_char,
+        };
+    }
+    engine->observer(engine->observer_ctx, &step);
+}
+
+static bool process_key(UnikeyEngine *engine, char c, UnikeyEdit *edit, int *result);
+
+bool unikey_key(UnikeyEngine *engine, char c, UnikeyEdit *edit) {
+    // English mode: the word stays empty, switching back starts clean
+    if (!engine->vietnamese) return false;
+    if (!engine->observer) {
+        int result;
+        return process_key(engine, c, edit, &result);
+    }
+
+    char before[MAX_WORD_LEN * 4 + 1];
+    word_to_utf8(&engine->word, before, sizeof(before));
+    TelexCheckpoint cp = telex_checkpoint(&engine->word);
+    int result;
+    bool changed = process_key(engine, c, edit, &result);
+    observe(engine, c, result, before, cp);
+    return changed;
+}
+
+static bool process_key(UnikeyEngine *engine, char c, UnikeyEdit *edit, int *result) {
+    Word *word = &engine->word;
+    *result = -1;
+
+    // Try the input method's transformation
+    if (word->len > 0 && telex_is_method_key(engine->method, c)) {
+        int old_len = word->len;
+        TelexCheckpoint cp = telex_checkpoint(word);
+
+        *result = telex_process_method(word, engine->method, c);
+        if (*result != 0) {
+            // Double press (2): tone undone, the key char is added
+            if (*result == 2) telex_append(word, (uint8_t)c);
+
+            // Delete the changed tail, then retype it
+            int start = telex_changed_from(word, cp);
+            edit->backspaces = telex_changed_units(word, cp, start, old_len, engine->encoding);
+            edit->text = engine->text;
+            edit->text_len = word_tail_encode(word, start, engine->encoding, engine->text,
+                                              sizeof(engine->text));
+            return true;
+        }
+
+        // No transformation, undo anything it touched
+        telex_rollback(word, cp);
+    }
+
+    // Just add to buffer (original keystroke goes through naturally)
+    telex_append(word, (uint8_t)c);
+    return false;
+}
+
+void unikey_set_observer(UnikeyEngine *engine, UnikeyObserver fn, void *ctx) {
+    engine->observer = fn;
+    engine->observer_ctx = ctx;
+}
+
+void unikey_backspace(UnikeyEngine *engine) {
+    // A backspace takes one codepoint: part of an NFD or VNI-Windows
+    // character is nothing the word can hold, start over
+    Word *word = &engine->word;
+    if (word->len > 0 && telex_encoded_units(word->chars[word->len - 1], engine->encoding) > 1) {
+        telex_reset(word);
+        return;
+    }
+    telex_backspace(word);
+    if (engine->word.len == 0) telex_reset(&engine->word);
+}
+
+int unikey_word(const UnikeyEngine *engine, char *buf, int size) {
+    return word_to_utf8(&engine->word, buf, size);
+}
+
+size_t unikey_convert(const char *in, size_t len, char *out) {
+    return conv_buffer(in, len, out);
+}
+
+int unikey_api_version(void) {
+    return UNIKEY_API_VERSION;
+}
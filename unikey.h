@@ -0,0 +1,131 @@
+#ifndef UNIKEY_H
+#define UNIKEY_H
+
+// libunikey: Vietnamese input engine (Telex, VNI, VIQR)
+//
+// Every UnikeyEngine is independent and the library has no mutable global
+// state, so any number of engines can run in parallel (one per keyboard,
+// thread or embedding process). A single engine must not be used from two
+// threads at once.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define UNIKEY_API_VERSION 4
+
+#if defined(__GNUC__)
+#define UNIKEY_API __attribute__((visibility("default")))
+#else
+#define UNIKEY_API
+#endif
+
+typedef struct UnikeyEngine UnikeyEngine;
+
+// Edit to apply to the text field after a key
+typedef struct {
+    int backspaces;     // Characters (codepoints) to delete before the cursor
+    const char *text;   // UTF-8 to type (owned by the engine, valid until the next call)
+    int text_len;       // Bytes in text
+} UnikeyEdit;
+
+// Input method: which keys add tones and marks
+typedef enum {
+    UNIKEY_TELEX,       // s f r x j tones, aa aw ee oo ow w dd
+    UNIKEY_VNI,         // 1-5 tones, 0 no tone, 6 ^, 7 horn, 8 breve, 9 đ
+    UNIKEY_VIQR,        // ' ` ? ~ . tones, ^ + ( marks, dd
+    UNIKEY_METHOD_COUNT
+} UnikeyMethod;
+
+// Encoding of UnikeyEdit.text, always UTF-8: legacy 8-bit charsets come as
+// the Latin-1 codepoints of their bytes. Backspaces count codepoints
+typedef enum {
+    UNIKEY_UNICODE,     // Precomposed (NFC)
+    UNIKEY_NFD,         // Base letter + combining marks
+    UNIKEY_TCVN3,       // TCVN 5712 VN3 (ABC)
+    UNIKEY_VNI_WIN,     // VNI-Windows
+    UNIKEY_VISCII,
+    UNIKEY_ENCODING_COUNT
+} UnikeyEncoding;
+
+// Word change recorded while processing a key
+typedef enum {
+    UNIKEY_TONE = 1,    // Tone mark added or moved
+    UNIKEY_MARK,        // Vowel mark (ă, â, ê, ô, ơ, ư)
+    UNIKEY_D_STROKE,    // d -> đ
+    UNIKEY_UNDO         // Double press undid a mark
+} UnikeyChangeType;
+
+typedef struct {
+    unsigned char type;         // UnikeyChangeType
+    unsigned char pos;          // Character index in the word
+    unsigned short from, to;    // Codepoints before and after
+} UnikeyChange;
+
+// Everything the engine decided about one unikey_key() call
+typedef struct {
+    char key;
+    int result;                 // 0 no change, 1 transformed, 2 mark undone
+                                // (key typed), -1 not a method key here
+    const char *before;         // Word as UTF-8 before and after the key
+    const char *after;          // (valid during the callback only)
+    int n_changes;
+    UnikeyChange changes[4];
+} UnikeyStep;
+
+// Called at the end of every Vietnamese-mode unikey_key() (debugging,
+// flight recording)
+typedef void (*UnikeyObserver)(void *ctx, const UnikeyStep *step);
+
+// Create an engine (Vietnamese mode on), NULL when out of memory
+UNIKEY_API UnikeyEngine *unikey_new(void);
+
+// Destroy an engine
+UNIKEY_API void unikey_free(UnikeyEngine *engine);
+
+// Forget the current word (cursor moved, focus changed, word break)
+UNIKEY_API void unikey_reset(UnikeyEngine *engine);
+
+// Vietnamese (true) or English (false) mode; switching resets the word.
+// In English mode unikey_key() does nothing and returns false
+UNIKEY_API void unikey_set_vietnamese(UnikeyEngine *engine, bool on);
+UNIKEY_API bool unikey_is_vietnamese(const UnikeyEngine *engine);
+
+// Input method (Telex by default); switching resets the word, an unknown
+// method is ignored. Since API version 3
+UNIKEY_API void unikey_set_method(UnikeyEngine *engine, UnikeyMethod method);
+UNIKEY_API UnikeyMethod unikey_get_method(const UnikeyEngine *engine);
+
+// True when c can transform a word in the current method (a digit in VNI,
+// punctuation in VIQR): such keys are part of the word. Since API version 3
+UNIKEY_API bool unikey_is_method_key(const UnikeyEngine *engine, char c);
+
+// Encoding of edits (Unicode NFC by default); switching resets the word, an
+// unknown encoding is ignored. unikey_word() and the observer stay NFC.
+// Since API version 4
+UNIKEY_API void unikey_set_encoding(UnikeyEngine *engine, UnikeyEncoding encoding);
+UNIKEY_API UnikeyEncoding unikey_get_encoding(const UnikeyEngine *engine);
+
+// A typed ASCII character. Returns true when the key transformed the word:
+// the key must not be typed itself, apply *edit instead (the backspaces do
+// not count the key). Returns false when the key should be typed as usual
+UNIKEY_API bool unikey_key(UnikeyEngine *engine, char c, UnikeyEdit *edit);
+
+// Report every key decision to fn (NULL to stop). Costs two short UTF-8
+// conversions per key while set, nothing otherwise. Since API version 2
+UNIKEY_API void unikey_set_observer(UnikeyEngine *engine, UnikeyObserver fn, void *ctx);
+
+// The user deleted the character before the cursor (one codepoint: in
+// NFD and VNI-Windows, deleting into a multi-codepoint letter forgets the
+// word)
+UNIKEY_API void unikey_backspace(UnikeyEngine *engine);
+
+// Current word as UTF-8, returns bytes written
+UNIKEY_API int unikey_word(const UnikeyEngine *engine, char *buf, int size);
+
+// Convert Telex text to UTF-8 (out holds 3 * len bytes), returns bytes written
+UNIKEY_API size_t unikey_convert(const char *in, size_t len, char *out);
+
+// Library API version (UNIKEY_API_VERSION it was built with)
+UNIKEY_API int unikey_api_version(void);
+
+#endif